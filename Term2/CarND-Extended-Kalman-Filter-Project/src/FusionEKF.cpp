@@ -1,5 +1,6 @@
 #include "FusionEKF.h"
 #include "tools.h"
+#include "trace.h"
 #include "Eigen/Dense"
 #include <iostream>
 
@@ -16,13 +17,12 @@ FusionEKF::FusionEKF() {
 
   previous_timestamp_ = 0;
 
+  count_ = 0;
+
   // initializing matrices
-  R_laser_ = MatrixXd(2, 2);
-  R_radar_ = MatrixXd(3, 3);
-  H_laser_ = MatrixXd(2, 4);
   H_laser_ << 1, 0, 0, 0,
               0, 1, 0, 0;
-  Hj_ = MatrixXd(3, 4);
+  Hj_.setZero();
 
   //measurement covariance matrix - laser
   R_laser_ << 0.0225, 0,
@@ -34,6 +34,9 @@ FusionEKF::FusionEKF() {
         0, 0, 0.09;
 
   noise_a_mpsps_ = 9;
+
+  // late measurements up to this many measurements back are inserted in order
+  SetHistoryLength(64);
      
 }
 
@@ -44,26 +47,20 @@ FusionEKF::~FusionEKF() {}
 
 void FusionEKF::ProcessMeasurement(const MeasurementPackage &measurement_pack) {
 
+  TRACE_SCOPE("ekf.process");
   count_ += 1;
-  cout << "***count_: " <<count_ << endl;
+  TRACE_LOG("***count_: " << count_);
 
   /*****************************************************************************
    *  Initialization
    ****************************************************************************/
   if (!is_initialized_) {
     // first measurement
-    cout << "EKF: " << endl;
-    ekf_.x_ = VectorXd(4);
-
-    ekf_.x_ = VectorXd(4);
     //state covariance matrix P
-    ekf_.P_ = MatrixXd(4, 4);
     ekf_.P_ << 1, 0, 0, 0,
               0, 1, 0, 0,
               0, 0, 1000, 0,
               0, 0, 0, 1000;
-    //state transition matrix P
-    ekf_.F_ = MatrixXd::Identity(4, 4);          
 
     if (measurement_pack.sensor_type_ == MeasurementPackage::RADAR) {
       ekf_.x_ << measurement_pack.raw_measurements_(0)*cos(measurement_pack.raw_measurements_(1)), 
@@ -78,62 +75,97 @@ void FusionEKF::ProcessMeasurement(const MeasurementPackage &measurement_pack) {
     }
     // done initializing, no need to predict or update
     is_initialized_ = true;
-    cout << "is_initialized_ using " << measurement_pack.sensor_type_ << endl;
+    TRACE_LOG("is_initialized_ using " << measurement_pack.sensor_type_);
     previous_timestamp_ = measurement_pack.timestamp_;
+    history_.Clear();
+    SaveState(history_.Insert(measurement_pack));
+    return;
+  }
+
+  if (measurement_pack.timestamp_ < previous_timestamp_) {
+    ProcessLateMeasurement(measurement_pack);
     return;
   }
 
+  int index = history_.Insert(measurement_pack);
+  Eigen::Vector3d z = Eigen::Vector3d::Zero();
+  z.head(measurement_pack.raw_measurements_.size()) = measurement_pack.raw_measurements_;
+  Step(measurement_pack.sensor_type_, measurement_pack.timestamp_, z);
+  SaveState(index);
+}
+
+void FusionEKF::SetHistoryLength(int length) {
+  history_ = History(length);
+}
+
+void FusionEKF::ProcessLateMeasurement(const MeasurementPackage &measurement_pack) {
+
+  TRACE_SCOPE("ekf.process_late");
+  //insert the measurement at its time and resume from the latest state saved before it
+  int restore;
+  int index = history_.InsertLate(measurement_pack, restore);
+  if (index < 0) {
+    TRACE_LOG("Dropped measurement at " << measurement_pack.timestamp_ << ", older than the history");
+    return;
+  }
+  TRACE_LOG("Late measurement at " << measurement_pack.timestamp_ << ", re-applying "
+            << history_.Size() - index << " measurements");
+
+  const SavedState &saved = history_[restore].state;
+  ekf_.x_ = saved.x;
+  ekf_.P_ = saved.P;
+  previous_timestamp_ = saved.timestamp;
+  for (int i = restore + 1; i < history_.Size(); i++) {
+    Step(history_[i].sensor_type, history_[i].timestamp, history_[i].z);
+    SaveState(i);
+  }
+}
+
+void FusionEKF::SaveState(int index) {
+  if (index < 0) {
+    return;
+  }
+  History::Entry &entry = history_[index];
+  entry.state.x = ekf_.x_;
+  entry.state.P = ekf_.P_;
+  entry.state.timestamp = previous_timestamp_;
+  entry.has_state = true;
+}
+
+void FusionEKF::Step(MeasurementPackage::SensorType sensor_type, long long timestamp,
+                     const Eigen::Vector3d &z) {
+
   /*****************************************************************************
    *  Prediction
    ****************************************************************************/
   //compute the time elapsed between the current and previous measurements
-  float dt_s = (measurement_pack.timestamp_ - previous_timestamp_) / 1000000.0; //dt - expressed in seconds
-  if (dt_s < 0)
-  {
-    return;
-  }
-  previous_timestamp_ = measurement_pack.timestamp_;
-  cout << "Processing measurement at " << measurement_pack.timestamp_ << endl;
-  cout << "dt = " << dt_s<< endl;
-  float dt_2 = dt_s * dt_s;
-  float dt_3 = dt_2 * dt_s;
-  float dt_4 = dt_3 * dt_s;
-
-  //Modify the F matrix so that the time is integrated
-  ekf_.F_(0, 2) = dt_s;
-  ekf_.F_(1, 3) = dt_s;
-
-  //set the process covariance matrix Q
-  ekf_.Q_ = MatrixXd(4, 4);
-  ekf_.Q_ <<  dt_4/4*noise_a_mpsps_, 0, dt_3/2*noise_a_mpsps_, 0,
-         0, dt_4/4*noise_a_mpsps_, 0, dt_3/2*noise_a_mpsps_,
-         dt_3/2*noise_a_mpsps_, 0, dt_2*noise_a_mpsps_, 0,
-         0, dt_3/2*noise_a_mpsps_, 0, dt_2*noise_a_mpsps_;
-
-  ekf_.Predict();
-  cout << "Prediction" << endl;
+  float dt_s = (timestamp - previous_timestamp_) / 1000000.0; //dt - expressed in seconds
+  previous_timestamp_ = timestamp;
+  TRACE_LOG("Processing measurement at " << timestamp);
+  TRACE_LOG("dt = " << dt_s);
+
+  //F and Q of the constant velocity model only couple each position with its own
+  //velocity, so the prediction is done in closed form instead of with dense matrices
+  ekf_.PredictConstantVelocity(dt_s, noise_a_mpsps_, noise_a_mpsps_);
   /*****************************************************************************
    *  Update
    ****************************************************************************/
 
-  if (measurement_pack.sensor_type_ == MeasurementPackage::RADAR) {
-    cout << "Update EKF, radar measurement" << endl;
-    ekf_.R_ = R_radar_;
-    ekf_.H_ = tools.CalculateJacobian(ekf_.x_);
-    VectorXd z = measurement_pack.raw_measurements_;
-    ekf_.UpdateEKF(z);
+  if (sensor_type == MeasurementPackage::RADAR) {
+    TRACE_LOG("Update EKF, radar measurement");
+    tools.CalculateJacobian(ekf_.x_, Hj_);
+    ekf_.UpdateEKF(z, Hj_, R_radar_);
   } 
   else
   { 
-    cout << "Update EKF, laser measurement" << endl;
+    TRACE_LOG("Update EKF, laser measurement");
     // Laser updates
-    ekf_.R_ = R_laser_;
-    ekf_.H_ = H_laser_;
-    VectorXd z = measurement_pack.raw_measurements_;
-    ekf_.Update(z);
+    ekf_.Update(z.head<2>(), H_laser_, R_laser_);
   }
 
-  // print the output
-  cout << "x_ = " << ekf_.x_ << endl;
-  cout << "P_ = " << ekf_.P_ << endl;
+  // trace the output
+  TRACE_STATE("ekf.x", timestamp, ekf_.x_);
+  TRACE_STATE("ekf.P", timestamp, ekf_.P_);
+  TRACE_LOG("x_ = " << ekf_.x_);
+  TRACE_LOG("P_ = " << ekf_.P_);
 }
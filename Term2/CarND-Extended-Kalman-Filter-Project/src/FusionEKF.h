@@ -7,10 +7,13 @@
 #include <string>
 #include <fstream>
 #include "kalman_filter.h"
+#include "measurement_history.h"
 #include "tools.h"
 
 class FusionEKF {
 public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   /**
   * Constructor.
   */
@@ -26,12 +29,45 @@ public:
   */
   void ProcessMeasurement(const MeasurementPackage &measurement_pack);
 
+  /**
+  * Sets how many of the latest measurements are kept so that a late one can be
+  * inserted at its time; a measurement older than all of them is dropped.
+  * Clears the history.
+  */
+  void SetHistoryLength(int length);
+
   /**
   * Kalman Filter update and prediction math lives in here.
   */
   KalmanFilter ekf_;
 
 private:
+  // filter state saved in the history after a measurement
+  struct SavedState {
+    Eigen::Vector4d x;
+    Eigen::Matrix4d P;
+    long long timestamp;
+  };
+  typedef MeasurementHistory<SavedState> History;
+
+  /**
+  * Inserts a measurement older than the state and re-applies the newer ones.
+  */
+  void ProcessLateMeasurement(const MeasurementPackage &measurement_pack);
+
+  /**
+  * Predicts to timestamp and updates with measurement z (laser: first two values).
+  */
+  void Step(MeasurementPackage::SensorType sensor_type, long long timestamp, const Eigen::Vector3d &z);
+
+  /**
+  * Saves the state in history entry index, if index is not -1.
+  */
+  void SaveState(int index);
+
+  // latest measurements with the state after them
+  History history_;
+
   // check whether the tracking toolbox was initialized or not (first measurement)
   bool is_initialized_;
 
@@ -40,10 +76,10 @@ private:
 
   // tool object used to compute Jacobian and RMSE
   Tools tools;
-  Eigen::MatrixXd R_laser_;
-  Eigen::MatrixXd R_radar_;
-  Eigen::MatrixXd H_laser_;
-  Eigen::MatrixXd Hj_;
+  Eigen::Matrix2d R_laser_;
+  Eigen::Matrix3d R_radar_;
+  KalmanFilter::LaserMatrix H_laser_;
+  KalmanFilter::RadarMatrix Hj_;
 
   int noise_a_mpsps_;
   uint count_;
@@ -0,0 +1,135 @@
+#ifndef KALMAN_CORE_H_
+#define KALMAN_CORE_H_
+
+#include "Eigen/Dense"
+#include <math.h>
+
+/**
+ * LDLTSolve Solves A * X = B in place for a small symmetric positive definite A
+ *   through its L * D * L^T factorization, reading only the lower triangle of A
+ * @return false, leaving B unchanged, if A is not positive definite
+ */
+template <int N, int M>
+bool LDLTSolve(const Eigen::Matrix<double, N, N>& A, Eigen::Matrix<double, N, M>& B) {
+  //unit lower triangular L below the diagonal, D on the diagonal
+  Eigen::Matrix<double, N, N> LD;
+  for (int j = 0; j < N; j++) {
+    double d = A(j, j);
+    for (int k = 0; k < j; k++) {
+      d -= LD(j, k)*LD(j, k)*LD(k, k);
+    }
+    if (!(d > 0)) {
+      return false;
+    }
+    LD(j, j) = d;
+    for (int i = j + 1; i < N; i++) {
+      double a = A(i, j);
+      for (int k = 0; k < j; k++) {
+        a -= LD(i, k)*LD(j, k)*LD(k, k);
+      }
+      LD(i, j) = a / d;
+    }
+  }
+
+  for (int c = 0; c < M; c++) {
+    //L * y = b, then D * w = y, then L^T * x = w
+    for (int i = 1; i < N; i++) {
+      for (int k = 0; k < i; k++) {
+        B(i, c) -= LD(i, k)*B(k, c);
+      }
+    }
+    for (int i = 0; i < N; i++) {
+      B(i, c) /= LD(i, i);
+    }
+    for (int i = N - 2; i >= 0; i--) {
+      for (int k = i + 1; k < N; k++) {
+        B(i, c) -= LD(k, i)*B(k, c);
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Linear Kalman filter arithmetic on fixed-size Eigen types.
+ *
+ * NX is the state dimension; the measurement dimension NZ is a template
+ * argument of Update, so every temporary has a compile-time size and lives on
+ * the stack: a predict or update does not touch the heap.
+ *
+ * Update takes the innovation rather than the measurement, so the same code
+ * serves a linear model (y = z - H * x) and a linearized one
+ * (y = z - h(x), H the Jacobian of h). The gain comes from an LDLT solve with
+ * the innovation covariance S instead of its inverse, and the covariance is
+ * updated in the symmetric form P - K * S * K^T, written as P - K * (H * P)
+ * and symmetrized, so rounding cannot make P_ drift away from symmetry.
+ */
+template <int NX>
+class KalmanCore {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  typedef Eigen::Matrix<double, NX, 1> StateVector;
+  typedef Eigen::Matrix<double, NX, NX> StateMatrix;
+
+  // state vector
+  StateVector x_;
+
+  // state covariance matrix
+  StateMatrix P_;
+
+  KalmanCore() {
+    x_.setZero();
+    P_.setIdentity();
+  }
+
+  /**
+   * Predict Predicts the state and the state covariance with a linear process model
+   * @param F State transition matrix
+   * @param Q Process covariance matrix
+   */
+  void Predict(const StateMatrix& F, const StateMatrix& Q) {
+    x_ = F * x_;
+    StateMatrix FP = F.lazyProduct(P_);
+    P_ = FP.lazyProduct(F.transpose()) + Q;
+  }
+
+  /**
+   * Update Updates the state and the state covariance with one measurement
+   * @param y Innovation, measurement minus predicted measurement
+   * @param H Measurement matrix, or the Jacobian of the measurement function
+   * @param R Measurement covariance matrix
+   * @return The normalized innovation squared y^T * S^-1 * y, or NAN if S is not
+   *   positive definite, in which case the state is left unchanged
+   */
+  template <int NZ>
+  double Update(const Eigen::Matrix<double, NZ, 1>& y, const Eigen::Matrix<double, NZ, NX>& H,
+                const Eigen::Matrix<double, NZ, NZ>& R) {
+    //H * P, the innovation covariance S and the cross covariance P * H^T = (H * P)^T
+    Eigen::Matrix<double, NZ, NX> HP = H.lazyProduct(P_);
+    Eigen::Matrix<double, NZ, NZ> S = HP.lazyProduct(H.transpose()) + R;
+
+    //solve S * [K^T | s] = [H * P | y] in one pass; then K = P * H^T * S^-1 and s = S^-1 * y
+    Eigen::Matrix<double, NZ, NX + 1> B;
+    B.template leftCols<NX>() = HP;
+    B.col(NX) = y;
+    if (!LDLTSolve(S, B)) {
+      return NAN;
+    }
+    Eigen::Matrix<double, NX, NZ> K = B.template leftCols<NX>().transpose();
+
+    //new state
+    x_ += K * y;
+    P_ -= K.lazyProduct(HP);
+    for (int j = 0; j < NX; j++) {
+      for (int i = j + 1; i < NX; i++) {
+        double p = 0.5*(P_(i, j) + P_(j, i));
+        P_(i, j) = p;
+        P_(j, i) = p;
+      }
+    }
+    return y.dot(B.col(NX));
+  }
+};
+
+#endif /* KALMAN_CORE_H_ */
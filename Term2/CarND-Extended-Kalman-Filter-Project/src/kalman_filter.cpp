@@ -1,90 +1,112 @@
 #include <math.h> 
 #include <iostream>
 #include "kalman_filter.h"
+#include "trace.h"
 
-using Eigen::MatrixXd;
-using Eigen::VectorXd;
+using Eigen::Matrix2d;
+using Eigen::Matrix3d;
+using Eigen::Matrix4d;
+using Eigen::Vector2d;
+using Eigen::Vector3d;
+using Eigen::Vector4d;
 
 // Local function
 static double wrap_rads(double r);
 // KF class
-KalmanFilter::KalmanFilter() {}
+KalmanFilter::KalmanFilter() {
+  F_.setIdentity();
+  Q_.setZero();
+}
 
 KalmanFilter::~KalmanFilter() {}
 
-void KalmanFilter::Init(VectorXd &x_in, MatrixXd &P_in, MatrixXd &F_in,
-                        MatrixXd &H_in, MatrixXd &R_in, MatrixXd &Q_in) {
+void KalmanFilter::Init(const Vector4d &x_in, const Matrix4d &P_in, const Matrix4d &F_in,
+                        const Matrix4d &Q_in) {
   x_ = x_in;
   P_ = P_in;
   F_ = F_in;
-  H_ = H_in;
-  R_ = R_in;
   Q_ = Q_in;
 }
 
 void KalmanFilter::Predict() {
 
-    x_ = F_ * x_;
-    MatrixXd Ft = F_.transpose();
-    P_ = F_ * P_ * Ft + Q_;
-    std::cout << "x_(prior) =" << x_ << std::endl;
+    TRACE_SCOPE("kf.predict");
+    KalmanCore<4>::Predict(F_, Q_);
+    TRACE_LOG("x_(prior) =" << x_);
 
 }
 
-void KalmanFilter::Update(const VectorXd &z) {
+void KalmanFilter::PredictConstantVelocity(double dt, double noise_ax, double noise_ay) {
+
+    TRACE_SCOPE("kf.predict_cv");
+    double dt_2 = dt * dt;
+    double dt_3 = dt_2 * dt;
+    double dt_4 = dt_3 * dt;
 
-    VectorXd y = z - H_ * x_;
-    MatrixXd Ht = H_.transpose();
-    MatrixXd S = H_ * P_ * Ht + R_;
-    MatrixXd Si = S.inverse();
-    MatrixXd K =  P_ * Ht * Si;
+    x_(0) += dt * x_(2);
+    x_(1) += dt * x_(3);
 
-    MatrixXd I = MatrixXd::Identity(4, 4);
+    //position block from the old position-velocity and velocity blocks
+    for (int a = 0; a < 2; a++) {
+      for (int b = 0; b <= a; b++) {
+        P_(a, b) += dt * (P_(a, b + 2) + P_(a + 2, b)) + dt_2 * P_(a + 2, b + 2);
+        P_(b, a) = P_(a, b);
+      }
+    }
+    //position-velocity block; the velocity block is unchanged
+    for (int a = 0; a < 2; a++) {
+      for (int b = 0; b < 2; b++) {
+        P_(a, b + 2) += dt * P_(a + 2, b + 2);
+        P_(b + 2, a) = P_(a, b + 2);
+      }
+    }
 
-    //new state
-    x_ = x_ + (K * y);
-    P_ = (I - K * H_) * P_;
+    //process noise
+    double noise[2] = { noise_ax, noise_ay };
+    for (int a = 0; a < 2; a++) {
+      P_(a, a) += dt_4 / 4 * noise[a];
+      P_(a, a + 2) += dt_3 / 2 * noise[a];
+      P_(a + 2, a) = P_(a, a + 2);
+      P_(a + 2, a + 2) += dt_2 * noise[a];
+    }
+    TRACE_LOG("x_(prior) =" << x_);
 }
 
-void KalmanFilter::UpdateEKF(const VectorXd &z) {
+void KalmanFilter::Update(const Vector2d &z, const LaserMatrix &H, const Matrix2d &R) {
+
+    TRACE_SCOPE("kf.update");
+    Vector2d y = z - H * x_;
+    KalmanCore<4>::Update(y, H, R);
+}
+
+void KalmanFilter::UpdateEKF(const Vector3d &z, const RadarMatrix &Hj, const Matrix3d &R) {
+    TRACE_SCOPE("kf.update_ekf");
     // map state to measurement space
-    VectorXd z_pred = VectorXd(3);
+    Vector3d z_pred;
     z_pred(0) = sqrt(x_(0)*x_(0) + x_(1)*x_(1));
     z_pred(1) = atan2(x_(1),x_(0));
     if (z_pred(0) <1e-4)
     {
         return;
     }
-    std::cout << "z =" << z << std::endl;
+    TRACE_LOG("z =" << z);
     z_pred(2) = (x_(0)*x_(2) + x_(1)*x_(3)) / z_pred(0);
-    std::cout << "z_pred =" << z_pred << std::endl;
-    VectorXd y = z - z_pred;
-    std::cout << "y(before) =" << y << std::endl;
+    TRACE_LOG("z_pred =" << z_pred);
+    Vector3d y = z - z_pred;
+    TRACE_LOG("y(before) =" << y);
     y(1) = wrap_rads(y(1)); // wrap angle between [PI ,- PI)
-    std::cout << "y(after) =" <<y << std::endl;
-    MatrixXd Ht = H_.transpose();
-    MatrixXd S = H_ * P_ * Ht + R_;
-    MatrixXd Si = S.inverse();
-    MatrixXd K =  P_ * Ht * Si;
-
-    MatrixXd I = MatrixXd::Identity(4, 4);
-
-    //new state
-    x_ = x_ + (K * y);
-    P_ = (I - K * H_) * P_;
+    TRACE_LOG("y(after) =" << y);
+    KalmanCore<4>::Update(y, Hj, R);
 }
 
 static double wrap_rads(double r)
 {
     while ( r > M_PI ) {
         r -= 2 * M_PI;
-        std::cout << "too big"<< std::endl;
-
     }
 
     while ( r <= -M_PI ) {
         r += 2 * M_PI;
-        std::cout << "too small"<< std::endl;
     }
 
     return r;
@@ -1,27 +1,23 @@
 #ifndef KALMAN_FILTER_H_
 #define KALMAN_FILTER_H_
 #include "Eigen/Dense"
+#include "kalman_core.h"
 
-class KalmanFilter {
+/**
+ * Constant velocity filter of the state [px, py, vx, vy] with lidar and radar
+ * updates. The arithmetic is KalmanCore's, so x_ and P_ are fixed-size and no
+ * step allocates.
+ */
+class KalmanFilter : public KalmanCore<4> {
 public:
-
-  // state vector
-  Eigen::VectorXd x_;
-
-  // state covariance matrix
-  Eigen::MatrixXd P_;
+  typedef Eigen::Matrix<double, 2, 4> LaserMatrix;
+  typedef Eigen::Matrix<double, 3, 4> RadarMatrix;
 
   // state transition matrix
-  Eigen::MatrixXd F_;
+  Eigen::Matrix4d F_;
 
   // process covariance matrix
-  Eigen::MatrixXd Q_;
-
-  // measurement matrix
-  Eigen::MatrixXd H_;
-
-  // measurement covariance matrix
-  Eigen::MatrixXd R_;
+  Eigen::Matrix4d Q_;
 
   /**
    * Constructor
@@ -38,31 +34,44 @@ public:
    * @param x_in Initial state
    * @param P_in Initial state covariance
    * @param F_in Transition matrix
-   * @param H_in Measurement matrix
-   * @param R_in Measurement covariance matrix
    * @param Q_in Process covariance matrix
    */
-  void Init(Eigen::VectorXd &x_in, Eigen::MatrixXd &P_in, Eigen::MatrixXd &F_in,
-      Eigen::MatrixXd &H_in, Eigen::MatrixXd &R_in, Eigen::MatrixXd &Q_in);
+  void Init(const Eigen::Vector4d &x_in, const Eigen::Matrix4d &P_in, const Eigen::Matrix4d &F_in,
+      const Eigen::Matrix4d &Q_in);
 
   /**
    * Prediction Predicts the state and the state covariance
-   * using the process model
-   * @param delta_T Time between k and k+1 in s
+   * using the process model F_ and Q_
    */
   void Predict();
 
+  /**
+   * PredictConstantVelocity Predicts with the constant velocity model directly,
+   * without F_ and Q_. In 2x2 blocks P = [A B; B^T C] (position, velocity) and
+   * F = [I dt*I; 0 I], so F * P * F^T is A + dt * (B + B^T) + dt^2 * C,
+   * B + dt * C and C, and Q only adds to the diagonals of the three blocks.
+   * This is a few dozen scalar operations, and x/y cross terms that are zero stay zero.
+   * @param dt Time between k and k+1 in s
+   * @param noise_ax Variance of the acceleration noise in x
+   * @param noise_ay Variance of the acceleration noise in y
+   */
+  void PredictConstantVelocity(double dt, double noise_ax, double noise_ay);
+
   /**
    * Updates the state by using standard Kalman Filter equations
    * @param z The measurement at k+1
+   * @param H Measurement matrix
+   * @param R Measurement covariance matrix
    */
-  void Update(const Eigen::VectorXd &z);
+  void Update(const Eigen::Vector2d &z, const LaserMatrix &H, const Eigen::Matrix2d &R);
 
   /**
    * Updates the state by using Extended Kalman Filter equations
    * @param z The measurement at k+1
+   * @param Hj Jacobian of the radar measurement function at x_
+   * @param R Measurement covariance matrix
    */
-  void UpdateEKF(const Eigen::VectorXd &z);
+  void UpdateEKF(const Eigen::Vector3d &z, const RadarMatrix &Hj, const Eigen::Matrix3d &R);
 
 };
 
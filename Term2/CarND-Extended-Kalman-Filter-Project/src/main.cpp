@@ -4,6 +4,7 @@
 #include <math.h>
 #include "FusionEKF.h"
 #include "tools.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -169,6 +170,13 @@ int main()
   h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
     ws.close();
     std::cout << "Disconnected" << std::endl;
+
+    // stage timings and state history of traced builds (-DENABLE_TRACE=ON, TRACE_LEVEL > 0)
+    trace::Report(std::cout);
+    const char* trace_file = getenv("TRACE_FILE");
+    if (trace_file) {
+      trace::WriteRing(trace_file);
+    }
   });
 
   int port = 4567;
@@ -0,0 +1,299 @@
+/*
+ * replay.cpp
+ *
+ * Offline driver: streams a recorded lidar/radar file through FusionEKF as fast
+ * as possible, without the simulator, and reports throughput, per-update
+ * latency percentiles and the RMSE against ground truth.
+ *
+ * Usage: ExtendedKF_replay [input_file] [--repeat n] [--tracker n]
+ *
+ * Every line of input_file is a measurement as sent by the simulator:
+ *   L px py timestamp x_gt y_gt vx_gt vy_gt ...
+ *   R rho phi rho_dot timestamp x_gt y_gt vx_gt vy_gt ...
+ * --repeat runs the whole file n times, each with a new filter, for steadier timings;
+ * --tracker runs EKFTracker on n objects that all follow the recorded path, each
+ * shifted on a grid, with one frame per line of the file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "FusionEKF.h"
+#include "tracker.h"
+#include "tools.h"
+
+using namespace std;
+using Eigen::VectorXd;
+
+typedef chrono::steady_clock Clock;
+
+/*
+ * Reads the measurements and ground truth, parsed like the simulator driver
+ */
+static bool read_measurements(const string& file_name, vector<MeasurementPackage>& measurements,
+                              vector<VectorXd>& ground_truth) {
+  ifstream in(file_name.c_str());
+  if (!in) {
+    return false;
+  }
+  string line;
+  while (getline(in, line)) {
+    istringstream iss(line);
+    string sensor_type;
+    iss >> sensor_type;
+    MeasurementPackage meas_package;
+    long long timestamp;
+    if (sensor_type.compare("L") == 0) {
+      meas_package.sensor_type_ = MeasurementPackage::LASER;
+      meas_package.raw_measurements_ = VectorXd(2);
+      float px, py;
+      iss >> px >> py;
+      meas_package.raw_measurements_ << px, py;
+    } else if (sensor_type.compare("R") == 0) {
+      meas_package.sensor_type_ = MeasurementPackage::RADAR;
+      meas_package.raw_measurements_ = VectorXd(3);
+      float ro, theta, ro_dot;
+      iss >> ro >> theta >> ro_dot;
+      meas_package.raw_measurements_ << ro, theta, ro_dot;
+    } else {
+      continue;
+    }
+    iss >> timestamp;
+    meas_package.timestamp_ = timestamp;
+    float x_gt, y_gt, vx_gt, vy_gt;
+    iss >> x_gt >> y_gt >> vx_gt >> vy_gt;
+    VectorXd gt_values(4);
+    gt_values << x_gt, y_gt, vx_gt, vy_gt;
+    measurements.push_back(meas_package);
+    ground_truth.push_back(gt_values);
+  }
+  return true;
+}
+
+/*
+ * Prints count and latency percentiles of one kind of update
+ */
+static void print_latency(const char* name, vector<double>& latency, const char* unit = "updates") {
+  cout << name;
+  if (latency.empty()) {
+    cout << "none" << endl;
+    return;
+  }
+  sort(latency.begin(), latency.end());
+  const double percentiles[] = { 0.5, 0.9, 0.99 };
+  cout << setw(8) << latency.size() << " " << unit << " ";
+  for (int i = 0; i < 3; i++) {
+    size_t index = min(latency.size() - 1, (size_t)(percentiles[i] * latency.size()));
+    cout << " p" << (int)(100 * percentiles[i]) << " " << setw(7) << 1e6 * latency[index];
+  }
+  cout << "  max " << setw(7) << 1e6 * latency.back() << endl;
+}
+
+/*
+ * Copies every measurement to num_objects objects on a grid of spacing meters.
+ * Laser positions keep their recorded noise. Radar positions are shifted in
+ * Cartesian coordinates and converted back, and the range rate keeps its
+ * recorded error against the ground truth. Object k of a frame is
+ * frames[i][k], with ground truth truth[i][k].
+ */
+static void build_frames(const vector<MeasurementPackage>& measurements, const vector<VectorXd>& ground_truth,
+                         int num_objects, double spacing, vector<vector<MeasurementPackage> >& frames,
+                         vector<vector<Eigen::Vector4d> >& truth) {
+  int columns = (int)ceil(sqrt((double)num_objects));
+  frames.assign(measurements.size(), vector<MeasurementPackage>(num_objects));
+  truth.assign(measurements.size(), vector<Eigen::Vector4d>(num_objects));
+  for (size_t i = 0; i < measurements.size(); i++) {
+    const MeasurementPackage& recorded = measurements[i];
+    const VectorXd& gt = ground_truth[i];
+    for (int k = 0; k < num_objects; k++) {
+      double dx = spacing * (k % columns);
+      double dy = spacing * (k / columns);
+      MeasurementPackage& meas_package = frames[i][k];
+      meas_package = recorded;
+      if (recorded.sensor_type_ == MeasurementPackage::LASER) {
+        meas_package.raw_measurements_(0) += dx;
+        meas_package.raw_measurements_(1) += dy;
+      } else {
+        double rho = recorded.raw_measurements_(0);
+        double phi = recorded.raw_measurements_(1);
+        double rho_dot_error = recorded.raw_measurements_(2)
+                             - (gt(0)*gt(2) + gt(1)*gt(3)) / sqrt(gt(0)*gt(0) + gt(1)*gt(1));
+        double px = rho*cos(phi) + dx;
+        double py = rho*sin(phi) + dy;
+        double gx = gt(0) + dx;
+        double gy = gt(1) + dy;
+        meas_package.raw_measurements_ << sqrt(px*px + py*py), atan2(py, px),
+                                          (gx*gt(2) + gy*gt(3)) / sqrt(gx*gx + gy*gy) + rho_dot_error;
+      }
+      truth[i][k] << gt(0) + dx, gt(1) + dy, gt(2), gt(3);
+    }
+  }
+}
+
+/*
+ * Runs EKFTracker over the frames of num_objects objects and prints the track
+ * count, the RMSE of the confirmed tracks against the objects they were
+ * associated with, and the per-frame latency
+ */
+static void replay_tracker(const vector<MeasurementPackage>& measurements, const vector<VectorXd>& ground_truth,
+                           int num_objects, int repeat) {
+  vector<vector<MeasurementPackage> > frames;
+  vector<vector<Eigen::Vector4d> > truth;
+  build_frames(measurements, ground_truth, num_objects, 20.0, frames, truth);
+
+  size_t total = frames.size() * repeat;
+  vector<double> laser_latency, radar_latency;
+  laser_latency.reserve(total);
+  radar_latency.reserve(total);
+  vector<int> index_of;
+
+  double total_time = 0;
+  Eigen::Vector4d squared_error = Eigen::Vector4d::Zero();
+  long long matched = 0;
+  int confirmed = 0;
+  int num_tracks = 0;
+  for (int pass = 0; pass < repeat; pass++) {
+    EKFTracker tracker;
+    squared_error.setZero();
+    matched = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+      Clock::time_point t0 = Clock::now();
+      tracker.ProcessFrame(frames[i][0].timestamp_, frames[i]);
+      Clock::time_point t1 = Clock::now();
+      double latency = chrono::duration<double>(t1 - t0).count();
+      total_time += latency;
+
+      // the first frame only starts the tracks
+      if (i > 0) {
+        if (frames[i][0].sensor_type_ == MeasurementPackage::LASER) {
+          laser_latency.push_back(latency);
+        } else {
+          radar_latency.push_back(latency);
+        }
+      }
+
+      // error of every confirmed track against the object whose measurement it took
+      index_of.assign(index_of.size(), -1);
+      for (int t = 0; t < tracker.NumTracks(); t++) {
+        if (tracker.TrackId(t) >= (int)index_of.size()) {
+          index_of.resize(tracker.TrackId(t) + 1, -1);
+        }
+        index_of[tracker.TrackId(t)] = t;
+      }
+      const vector<int>& associations = tracker.Associations();
+      for (int k = 0; k < num_objects; k++) {
+        int track = associations[k] < 0 ? -1 : index_of[associations[k]];
+        if (track < 0 || !tracker.IsConfirmed(track)) {
+          continue;
+        }
+        EKFTracker::StateVector x;
+        EKFTracker::StateMatrix P;
+        tracker.GetTrack(track, x, P);
+        squared_error += (x - truth[i][k]).cwiseAbs2();
+        matched++;
+      }
+    }
+    num_tracks = tracker.NumTracks();
+    confirmed = 0;
+    for (int t = 0; t < num_tracks; t++) {
+      confirmed += tracker.IsConfirmed(t);
+    }
+  }
+
+  Eigen::Vector4d rmse = (squared_error / max(1LL, matched)).cwiseSqrt();
+  cout << fixed << setprecision(4);
+  cout << "Objects:          " << num_objects << ", " << frames.size() << " frames x " << repeat << " pass(es)" << endl;
+  cout << "Tracks:           " << confirmed << " confirmed, " << num_tracks << " in total at the end" << endl;
+  cout << "RMSE x/y/vx/vy:   " << rmse(0) << " " << rmse(1) << " " << rmse(2) << " " << rmse(3)
+       << " (" << matched << " confirmed associations)" << endl;
+  cout << setprecision(2);
+  cout << "Latency [us]:" << endl;
+  print_latency("  laser ", laser_latency, "frames");
+  print_latency("  radar ", radar_latency, "frames");
+  cout << "Runtime:          " << total_time << " s, " << setprecision(0) << total / total_time
+       << " frames/s, " << total * num_objects / total_time << " measurements/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  string input_file = "../data/obj_pose-laser-radar-synthetic-input.txt";
+  int repeat = 1;
+  int num_objects = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+      repeat = max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--tracker") && i + 1 < argc) {
+      num_objects = max(1, atoi(argv[++i]));
+    } else if (argv[i][0] != '-') {
+      input_file = argv[i];
+    } else {
+      cerr << "Usage: " << argv[0] << " [input_file] [--repeat n] [--tracker n]" << endl;
+      return -1;
+    }
+  }
+
+  vector<MeasurementPackage> measurements;
+  vector<VectorXd> ground_truth;
+  if (!read_measurements(input_file, measurements, ground_truth) || measurements.empty()) {
+    cout << "Error: Could not read measurements from " << input_file << endl;
+    return -1;
+  }
+  if (num_objects > 0) {
+    replay_tracker(measurements, ground_truth, num_objects, repeat);
+    return 0;
+  }
+
+  // Everything the timed loop writes is allocated up front
+  size_t total = measurements.size() * repeat;
+  vector<double> laser_latency, radar_latency;
+  laser_latency.reserve(total);
+  radar_latency.reserve(total);
+  vector<VectorXd> estimations(measurements.size(), VectorXd(4));
+
+  double total_time = 0;
+  for (int pass = 0; pass < repeat; pass++) {
+    FusionEKF fusionEKF;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < measurements.size(); i++) {
+      Clock::time_point t0 = Clock::now();
+      fusionEKF.ProcessMeasurement(measurements[i]);
+      Clock::time_point t1 = Clock::now();
+
+      // the first measurement only initializes the filter
+      if (i > 0) {
+        double latency = chrono::duration<double>(t1 - t0).count();
+        if (measurements[i].sensor_type_ == MeasurementPackage::LASER) {
+          laser_latency.push_back(latency);
+        } else {
+          radar_latency.push_back(latency);
+        }
+      }
+      estimations[i] = fusionEKF.ekf_.x_;
+    }
+    total_time += chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // Every pass gives the same estimates
+  Tools tools;
+  VectorXd rmse = tools.CalculateRMSE(estimations, ground_truth);
+
+  cout << fixed << setprecision(4);
+  cout << "Measurements:     " << measurements.size() << " x " << repeat << " pass(es)" << endl;
+  cout << "RMSE x/y/vx/vy:   " << rmse(0) << " " << rmse(1) << " " << rmse(2) << " " << rmse(3) << endl;
+  cout << setprecision(2);
+  cout << "Latency [us]:" << endl;
+  print_latency("  laser ", laser_latency);
+  print_latency("  radar ", radar_latency);
+  cout << "Runtime:          " << total_time << " s, " << setprecision(0) << total / total_time
+       << " measurements/s" << endl;
+
+  return 0;
+}
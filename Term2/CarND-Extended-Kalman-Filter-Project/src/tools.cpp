@@ -1,5 +1,6 @@
 #include <iostream>
 #include "tools.h"
+#include "trace.h"
 
 using Eigen::VectorXd;
 using Eigen::MatrixXd;
@@ -42,28 +43,33 @@ VectorXd Tools::CalculateRMSE(const vector<VectorXd> &estimations,
 
 MatrixXd Tools::CalculateJacobian(const VectorXd& x_state) {
 
-    MatrixXd Hj(3,4);
+    Eigen::Matrix<double, 3, 4> Hj;
+    CalculateJacobian(Eigen::Vector4d(x_state), Hj);
+    return Hj;
+}
+
+void Tools::CalculateJacobian(const Eigen::Vector4d& x_state, Eigen::Matrix<double, 3, 4>& Hj) {
+
     //recover state parameters
-    float px = x_state(0);
-    float py = x_state(1);
-    float vx = x_state(2);
-    float vy = x_state(3);
+    double px = x_state(0);
+    double py = x_state(1);
+    double vx = x_state(2);
+    double vy = x_state(3);
 
     //pre-compute a set of terms to avoid repeated calculation
-    float c1 = px*px+py*py;
-    float c2 = sqrt(c1);
-    float c3 = (c1*c2);
+    double c1 = px*px+py*py;
+    double c2 = sqrt(c1);
+    double c3 = (c1*c2);
 
     //check division by zero
     if(fabs(c1) < 0.0001){
-        cout << "CalculateJacobian () - Error - Division by Zero" << endl;
-        return Hj;
+        TRACE_LOG("CalculateJacobian () - Error - Division by Zero");
+        Hj.setZero();
+        return;
     }
 
     //compute the Jacobian matrix
     Hj << (px/c2), (py/c2), 0, 0,
           -(py/c1), (px/c1), 0, 0,
           py*(vx*py - vy*px)/c3, px*(px*vy - py*vx)/c3, px/c2, py/c2;
-
-    return Hj;
 }
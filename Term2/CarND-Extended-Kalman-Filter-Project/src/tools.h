@@ -29,6 +29,12 @@ public:
   */
   MatrixXd CalculateJacobian(const VectorXd& x_state);
 
+  /**
+  * Jacobian of the radar measurement function into a fixed-size matrix, without allocating.
+  * Hj is set to zero if px and py are both close to zero.
+  */
+  void CalculateJacobian(const Eigen::Vector4d& x_state, Eigen::Matrix<double, 3, 4>& Hj);
+
 };
 
 #endif /* TOOLS_H_ */
@@ -0,0 +1,96 @@
+#include "trace.h"
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+namespace trace {
+
+static int LevelFromEnvironment() {
+  const char* value = getenv("TRACE_LEVEL");
+  return value ? atoi(value) : LEVEL_OFF;
+}
+
+atomic<int> current_level(LevelFromEnvironment());
+
+// Registered counters and the ring buffer, guarded by the mutex
+static mutex trace_mutex;
+static Counter* counters = NULL;
+static vector<Record> ring;
+static size_t ring_capacity = 4096;
+static uint64_t num_records = 0;
+
+Counter::Counter(const char* name) : name_(name), count_(0), total_ns_(0), max_ns_(0) {
+  lock_guard<mutex> lock(trace_mutex);
+  next_ = counters;
+  counters = this;
+}
+
+ScopeTimer::ScopeTimer(Counter& counter) : counter_(NULL) {
+  if (GetLevel() >= LEVEL_TIMING) {
+    counter_ = &counter;
+    start_ = chrono::steady_clock::now();
+  }
+}
+
+void SetLevel(int level) {
+  current_level.store(level, memory_order_relaxed);
+}
+
+void SetRingCapacity(int records) {
+  lock_guard<mutex> lock(trace_mutex);
+  ring_capacity = records > 0 ? records : 1;
+  ring.clear();
+  num_records = 0;
+}
+
+void RecordState(const char* tag, long long timestamp, const double* values, int rows, int cols) {
+  lock_guard<mutex> lock(trace_mutex);
+  if (ring.empty()) {
+    ring.resize(ring_capacity);
+  }
+  Record& record = ring[num_records % ring_capacity];
+  record.sequence = num_records++;
+  record.timestamp = timestamp;
+  strncpy(record.tag, tag, sizeof(record.tag) - 1);
+  record.tag[sizeof(record.tag) - 1] = '\0';
+  record.rows = rows;
+  record.cols = cols;
+  int n = rows * cols < MAX_VALUES ? rows * cols : MAX_VALUES;
+  memcpy(record.values, values, n * sizeof(double));
+  memset(record.values + n, 0, (MAX_VALUES - n) * sizeof(double));
+}
+
+void Report(ostream& out) {
+  lock_guard<mutex> lock(trace_mutex);
+  for (Counter* counter = counters; counter; counter = counter->next_) {
+    uint64_t count = counter->count_.load();
+    if (count == 0) {
+      continue;
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "%-24s %10llu calls  mean %10.3f us  max %10.3f us", counter->name_,
+             (unsigned long long)count, counter->total_ns_.load() * 1e-3 / count, counter->max_ns_.load() * 1e-3);
+    out << line << endl;
+  }
+}
+
+bool WriteRing(const char* path) {
+  lock_guard<mutex> lock(trace_mutex);
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  uint64_t stored = num_records < ring_capacity ? num_records : ring_capacity;
+  uint32_t header[3] = { 1, (uint32_t)sizeof(Record), (uint32_t)stored };
+  bool ok = fwrite("TRACERNG", 8, 1, file) == 1 && fwrite(header, sizeof(header), 1, file) == 1;
+  for (uint64_t i = num_records - stored; ok && i < num_records; i++) {
+    ok = fwrite(&ring[i % ring_capacity], sizeof(Record), 1, file) == 1;
+  }
+  return fclose(file) == 0 && ok;
+}
+
+}
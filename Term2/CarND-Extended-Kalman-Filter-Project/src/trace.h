@@ -0,0 +1,146 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+
+/**
+ * Diagnostics for the filter hot path.
+ *
+ * Everything goes through the TRACE_* macros below. Unless the build defines
+ * ENABLE_TRACE (cmake -DENABLE_TRACE=ON) they expand to nothing, so production
+ * builds pay nothing. Traced builds check a runtime level first, taken from the
+ * TRACE_LEVEL environment variable or set with trace::SetLevel:
+ *   1 timing   per-stage call counts and durations (TRACE_SCOPE), see trace::Report
+ *   2 state    also keeps state vectors and covariances in a binary ring buffer
+ *              (TRACE_STATE), see trace::WriteRing
+ *   3 verbose  also prints the TRACE_LOG messages to std::clog
+ */
+namespace trace {
+
+enum Level { LEVEL_OFF = 0, LEVEL_TIMING = 1, LEVEL_STATE = 2, LEVEL_VERBOSE = 3 };
+
+// Longest vector or matrix a ring record holds; larger ones are truncated
+const int MAX_VALUES = 25;
+
+/**
+ * One ring buffer entry as written by WriteRing
+ */
+struct Record {
+  uint64_t sequence;         // Running number of the record
+  int64_t timestamp;         // Measurement timestamp the caller passed
+  char tag[16];              // Null-terminated name of the traced quantity
+  int32_t rows, cols;        // Shape; values are column-major
+  double values[MAX_VALUES];
+};
+
+/**
+ * Call count and time spent in one TRACE_SCOPE
+ */
+class Counter {
+public:
+  explicit Counter(const char* name);
+
+  void Add(uint64_t ns) {
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max_ns && !max_ns_.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  const char* name_;
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> total_ns_;
+  std::atomic<uint64_t> max_ns_;
+  Counter* next_;  // Registered counters form a list
+};
+
+class ScopeTimer {
+public:
+  explicit ScopeTimer(Counter& counter);
+  ~ScopeTimer() {
+    if (counter_) {
+      counter_->Add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_).count());
+    }
+  }
+
+private:
+  Counter* counter_;  // NULL if timing was off when the scope started
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Runtime level, read through GetLevel
+extern std::atomic<int> current_level;
+
+/**
+ * GetLevel Returns the current runtime level
+ */
+inline int GetLevel() {
+  return current_level.load(std::memory_order_relaxed);
+}
+
+void SetLevel(int level);
+
+/**
+ * SetRingCapacity Sets the number of records kept (default 4096); clears the ring
+ */
+void SetRingCapacity(int records);
+
+/**
+ * RecordState Appends a column-major vector or matrix to the ring buffer
+ */
+void RecordState(const char* tag, long long timestamp, const double* values, int rows, int cols);
+
+/**
+ * Report Prints the call count, mean and max duration of every stage
+ */
+void Report(std::ostream& out);
+
+/**
+ * WriteRing Writes the ring buffer, oldest record first, after a header of
+ *   "TRACERNG", the format version, sizeof(Record) and the record count (uint32 each)
+ * @return false if the file could not be written
+ */
+bool WriteRing(const char* path);
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef ENABLE_TRACE
+
+// Times the rest of the enclosing scope under the given stage name
+#define TRACE_SCOPE(name) \
+  static trace::Counter TRACE_CONCAT(trace_counter_, __LINE__)(name); \
+  trace::ScopeTimer TRACE_CONCAT(trace_timer_, __LINE__)(TRACE_CONCAT(trace_counter_, __LINE__))
+
+// Keeps a copy of an Eigen vector or matrix in the ring buffer
+#define TRACE_STATE(tag, timestamp, m) \
+  do { \
+    if (trace::GetLevel() >= trace::LEVEL_STATE) { \
+      trace::RecordState(tag, timestamp, (m).data(), (int)(m).rows(), (int)(m).cols()); \
+    } \
+  } while (0)
+
+// Prints a message built with <<; the operands are not evaluated unless verbose
+#define TRACE_LOG(message) \
+  do { \
+    if (trace::GetLevel() >= trace::LEVEL_VERBOSE) { \
+      std::clog << message << std::endl; \
+    } \
+  } while (0)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_STATE(tag, timestamp, m) do {} while (0)
+#define TRACE_LOG(message) do {} while (0)
+
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,598 @@
+#include "tracker.h"
+#include "trace.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+using namespace std;
+using Eigen::VectorXd;
+
+namespace {
+
+// Cost of a track-measurement pair outside the gate; never part of an optimal assignment
+const double kNotGated = 1e12;
+
+// Tracks per chunk of the scan for gated pairs
+const int kChunk = 16;
+
+/*
+ * Rounds to the nearest integer with the 1.5 * 2^52 trick, which vectorizes
+ * unlike floor or nearbyint. Valid for |v| < 2^51.
+ */
+inline double RoundNearest(double v) {
+  const double magic = 6755399441055744.0;
+  return (v + magic) - magic;
+}
+
+// Wraps an angle to [-pi, pi] without a loop
+inline double WrapAngle(double angle) {
+  return angle - 2.*M_PI * RoundNearest(angle * (0.5 / M_PI));
+}
+
+}
+
+EKFTracker::EKFTracker()
+    : time_us_(0), has_time_(false), next_id_(0), num_tracks_(0), capacity_(0) {
+
+  // same noise as FusionEKF
+  noise_ax_ = 9;
+  noise_ay_ = 9;
+  R_laser_ << 0.0225, 0,
+        0, 0.0225;
+  R_radar_ << 0.09, 0, 0,
+        0, 0.0009, 0,
+        0, 0, 0.09;
+  H_laser_ << 1, 0, 0, 0,
+              0, 1, 0, 0;
+
+  // chi-square 99% quantiles for 2 and 3 degrees of freedom
+  gate_laser_ = 9.210;
+  gate_radar_ = 11.345;
+  // and the 1 - 1e-6 quantiles
+  birth_gate_laser_ = 27.631;
+  birth_gate_radar_ = 30.665;
+
+  confirm_hits_ = 3;
+  max_misses_ = 5;
+  max_tentative_misses_ = 1;
+
+  // as the first state of FusionEKF: the velocity is unknown
+  P_birth_ << 1, 0, 0, 0,
+              0, 1, 0, 0,
+              0, 0, 1000, 0,
+              0, 0, 0, 1000;
+
+  Reserve(16);
+}
+
+void EKFTracker::Reserve(int capacity) {
+  if (capacity <= capacity_) {
+    return;
+  }
+  // repack every component row with the new stride
+  vector<double> x(NX * capacity), P(NX * NX * capacity);
+  for (int k = 0; k < NX; k++) {
+    copy(x_.begin() + k * capacity_, x_.begin() + k * capacity_ + num_tracks_, x.begin() + k * capacity);
+  }
+  for (int k = 0; k < NX * NX; k++) {
+    copy(P_.begin() + k * capacity_, P_.begin() + k * capacity_ + num_tracks_, P.begin() + k * capacity);
+  }
+  x_.swap(x);
+  P_.swap(P);
+  ids_.resize(capacity);
+  hits_.resize(capacity);
+  misses_.resize(capacity);
+  updated_.resize(capacity);
+  z_pred_.resize(3 * capacity);
+  S_inv_.resize(6 * capacity);
+  d2_.resize(capacity);
+  capacity_ = capacity;
+}
+
+int EKFTracker::AddTrack(const StateVector& x) {
+  if (num_tracks_ == capacity_) {
+    Reserve(2 * capacity_);
+  }
+  int t = num_tracks_++;
+  for (int k = 0; k < NX; k++) {
+    x_[k * capacity_ + t] = x(k);
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j < NX; j++) {
+      P_[(i * NX + j) * capacity_ + t] = P_birth_(i, j);
+    }
+  }
+  ids_[t] = next_id_++;
+  hits_[t] = 0;
+  misses_[t] = 0;
+  updated_[t] = 0;
+  return t;
+}
+
+void EKFTracker::RemoveTrack(int track) {
+  int last = --num_tracks_;
+  for (int k = 0; k < NX; k++) {
+    x_[k * capacity_ + track] = x_[k * capacity_ + last];
+  }
+  for (int k = 0; k < NX * NX; k++) {
+    P_[k * capacity_ + track] = P_[k * capacity_ + last];
+  }
+  ids_[track] = ids_[last];
+  hits_[track] = hits_[last];
+  misses_[track] = misses_[last];
+  updated_[track] = updated_[last];
+}
+
+void EKFTracker::GetTrack(int track, StateVector& x, StateMatrix& P) const {
+  for (int k = 0; k < NX; k++) {
+    x(k) = x_[k * capacity_ + track];
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j < NX; j++) {
+      P(i, j) = P_[(i * NX + j) * capacity_ + track];
+    }
+  }
+}
+
+void EKFTracker::ProcessFrame(long long timestamp, const vector<MeasurementPackage>& measurements) {
+  TRACE_SCOPE("tracker.frame");
+  if (has_time_ && timestamp < time_us_) {
+    TRACE_LOG("Ignored frame at " << timestamp << ", older than " << time_us_);
+    return;
+  }
+  double dt = has_time_ ? (timestamp - time_us_) / 1000000.0 : 0;
+  time_us_ = timestamp;
+  has_time_ = true;
+
+  Predict(dt);
+  associations_.assign(measurements.size(), -1);
+  Associate(MeasurementPackage::LASER, measurements);
+  Associate(MeasurementPackage::RADAR, measurements);
+
+  //tracks that went without a measurement for too long are deleted; the last
+  //track moves into a deleted index, and it was already visited
+  for (int t = num_tracks_ - 1; t >= 0; t--) {
+    misses_[t] = updated_[t] ? 0 : misses_[t] + 1;
+    updated_[t] = 0;
+    if (misses_[t] > (IsConfirmed(t) ? max_misses_ : max_tentative_misses_)) {
+      TRACE_LOG("Deleted track " << ids_[t]);
+      RemoveTrack(t);
+    }
+  }
+  TRACE_LOG("Frame at " << timestamp << ": " << measurements.size() << " measurements, "
+            << num_tracks_ << " tracks");
+}
+
+/*
+ * Constant velocity prediction of every track, the closed form of
+ * KalmanFilter::PredictConstantVelocity with the track loop innermost
+ */
+void EKFTracker::Predict(double dt) {
+  TRACE_SCOPE("tracker.predict");
+  const int n = num_tracks_;
+  const int cap = capacity_;
+  double dt_2 = dt * dt;
+  double dt_3 = dt_2 * dt;
+  double dt_4 = dt_3 * dt;
+
+  for (int a = 0; a < 2; a++) {
+    double* pos = &x_[a * cap];
+    const double* vel = &x_[(a + 2) * cap];
+    for (int t = 0; t < n; t++) {
+      pos[t] += dt * vel[t];
+    }
+  }
+
+  //position block from the old position-velocity and velocity blocks
+  for (int a = 0; a < 2; a++) {
+    for (int b = 0; b < 2; b++) {
+      double* Pab = &P_[(a * NX + b) * cap];
+      const double* Pab2 = &P_[(a * NX + b + 2) * cap];
+      const double* Pa2b = &P_[((a + 2) * NX + b) * cap];
+      const double* Pa2b2 = &P_[((a + 2) * NX + b + 2) * cap];
+      for (int t = 0; t < n; t++) {
+        Pab[t] += dt * (Pab2[t] + Pa2b[t]) + dt_2 * Pa2b2[t];
+      }
+    }
+  }
+  //position-velocity blocks; the velocity block is unchanged
+  for (int a = 0; a < 2; a++) {
+    for (int b = 0; b < 2; b++) {
+      double* Pab2 = &P_[(a * NX + b + 2) * cap];
+      double* Pb2a = &P_[((b + 2) * NX + a) * cap];
+      const double* Pa2b2 = &P_[((a + 2) * NX + b + 2) * cap];
+      for (int t = 0; t < n; t++) {
+        Pab2[t] += dt * Pa2b2[t];
+        Pb2a[t] = Pab2[t];
+      }
+    }
+  }
+
+  //process noise
+  double noise[2] = { noise_ax_, noise_ay_ };
+  for (int a = 0; a < 2; a++) {
+    double* Paa = &P_[(a * NX + a) * cap];
+    double* Paa2 = &P_[(a * NX + a + 2) * cap];
+    double* Pa2a = &P_[((a + 2) * NX + a) * cap];
+    double* Pa2a2 = &P_[((a + 2) * NX + a + 2) * cap];
+    for (int t = 0; t < n; t++) {
+      Paa[t] += dt_4 / 4 * noise[a];
+      Paa2[t] += dt_3 / 2 * noise[a];
+      Pa2a[t] = Paa2[t];
+      Pa2a2[t] += dt_2 * noise[a];
+    }
+  }
+}
+
+void EKFTracker::PrepareLaser() {
+  const int n = num_tracks_;
+  const int cap = capacity_;
+  const double* px = &x_[0];
+  const double* py = &x_[cap];
+  const double* P00 = &P_[0];
+  const double* P01 = &P_[cap];
+  const double* P11 = &P_[(NX + 1) * cap];
+  double* zp0 = &z_pred_[0];
+  double* zp1 = &z_pred_[cap];
+  double* Si00 = &S_inv_[0];
+  double* Si01 = &S_inv_[cap];
+  double* Si11 = &S_inv_[2 * cap];
+  for (int t = 0; t < n; t++) {
+    zp0[t] = px[t];
+    zp1[t] = py[t];
+    //S = H * P * H^T + R is the position block of P plus R
+    double s00 = P00[t] + R_laser_(0, 0);
+    double s01 = P01[t] + R_laser_(0, 1);
+    double s11 = P11[t] + R_laser_(1, 1);
+    double det_inv = 1 / (s00 * s11 - s01 * s01);
+    Si00[t] = s11 * det_inv;
+    Si01[t] = -s01 * det_inv;
+    Si11[t] = s00 * det_inv;
+  }
+}
+
+void EKFTracker::PrepareRadar() {
+  const int n = num_tracks_;
+  const int cap = capacity_;
+  for (int t = 0; t < n; t++) {
+    double px = x_[t];
+    double py = x_[cap + t];
+    double vx = x_[2 * cap + t];
+    double vy = x_[3 * cap + t];
+    double c1 = px*px + py*py;
+    double c2 = sqrt(c1);
+    double c3 = c1 * c2;
+
+    //a track at the sensor has no defined bearing: a NAN prediction fails every gate
+    double rho = c2 < 1e-4 ? NAN : c2;
+    z_pred_[t] = rho;
+    z_pred_[cap + t] = atan2(py, px);
+    z_pred_[2 * cap + t] = (px*vx + py*vy) / rho;
+
+    //Jacobian of the radar measurement function, as Tools::CalculateJacobian
+    double H[3][NX] = {
+      { px/c2, py/c2, 0, 0 },
+      { -py/c1, px/c1, 0, 0 },
+      { py*(vx*py - vy*px)/c3, px*(px*vy - py*vx)/c3, px/c2, py/c2 }
+    };
+    double HP[3][NX];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < NX; j++) {
+        double sum = 0;
+        for (int k = 0; k < NX; k++) {
+          sum += H[i][k] * P_[(k * NX + j) * cap + t];
+        }
+        HP[i][j] = sum;
+      }
+    }
+    double S[3][3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j <= i; j++) {
+        double sum = R_radar_(i, j);
+        for (int k = 0; k < NX; k++) {
+          sum += HP[i][k] * H[j][k];
+        }
+        S[i][j] = sum;
+      }
+    }
+
+    //inverse of the symmetric S from its cofactors
+    double a = S[0][0], b = S[1][0], c = S[2][0], d = S[1][1], e = S[2][1], f = S[2][2];
+    double A00 = d*f - e*e;
+    double A01 = c*e - b*f;
+    double A02 = b*e - c*d;
+    double det_inv = 1 / (a*A00 + b*A01 + c*A02);
+    S_inv_[t] = A00 * det_inv;
+    S_inv_[cap + t] = A01 * det_inv;
+    S_inv_[2 * cap + t] = A02 * det_inv;
+    S_inv_[3 * cap + t] = (a*f - c*c) * det_inv;
+    S_inv_[4 * cap + t] = (b*c - a*e) * det_inv;
+    S_inv_[5 * cap + t] = (a*d - b*b) * det_inv;
+  }
+}
+
+void EKFTracker::DistancesLaser(const VectorXd& z) {
+  const int n = num_tracks_;
+  const int cap = capacity_;
+  const double* zp0 = &z_pred_[0];
+  const double* zp1 = &z_pred_[cap];
+  const double* Si00 = &S_inv_[0];
+  const double* Si01 = &S_inv_[cap];
+  const double* Si11 = &S_inv_[2 * cap];
+  double z0 = z(0), z1 = z(1);
+  double* d2 = &d2_[0];
+  for (int t = 0; t < n; t++) {
+    double y0 = z0 - zp0[t];
+    double y1 = z1 - zp1[t];
+    d2[t] = Si00[t]*y0*y0 + 2*Si01[t]*y0*y1 + Si11[t]*y1*y1;
+  }
+}
+
+void EKFTracker::DistancesRadar(const VectorXd& z) {
+  const int n = num_tracks_;
+  const int cap = capacity_;
+  const double* zp0 = &z_pred_[0];
+  const double* zp1 = &z_pred_[cap];
+  const double* zp2 = &z_pred_[2 * cap];
+  const double* Si00 = &S_inv_[0];
+  const double* Si01 = &S_inv_[cap];
+  const double* Si02 = &S_inv_[2 * cap];
+  const double* Si11 = &S_inv_[3 * cap];
+  const double* Si12 = &S_inv_[4 * cap];
+  const double* Si22 = &S_inv_[5 * cap];
+  double z0 = z(0), z1 = z(1), z2 = z(2);
+  double* d2 = &d2_[0];
+  for (int t = 0; t < n; t++) {
+    double y0 = z0 - zp0[t];
+    double y1 = WrapAngle(z1 - zp1[t]);
+    double y2 = z2 - zp2[t];
+    d2[t] = Si00[t]*y0*y0 + Si11[t]*y1*y1 + Si22[t]*y2*y2
+            + 2*(Si01[t]*y0*y1 + Si02[t]*y0*y2 + Si12[t]*y1*y2);
+  }
+}
+
+int EKFTracker::Find(int node) {
+  while (parent_[node] != node) {
+    parent_[node] = parent_[parent_[node]];
+    node = parent_[node];
+  }
+  return node;
+}
+
+void EKFTracker::Associate(MeasurementPackage::SensorType sensor_type,
+                           const vector<MeasurementPackage>& measurements) {
+  TRACE_SCOPE("tracker.associate");
+  pass_.clear();
+  for (size_t i = 0; i < measurements.size(); i++) {
+    if (measurements[i].sensor_type_ == sensor_type) {
+      pass_.push_back(i);
+    }
+  }
+  if (pass_.empty()) {
+    return;
+  }
+  const int num_measurements = pass_.size();
+  const int num_tracks = num_tracks_;
+  const bool radar = sensor_type == MeasurementPackage::RADAR;
+  const double gate = radar ? gate_radar_ : gate_laser_;
+  const double birth_gate = radar ? birth_gate_radar_ : birth_gate_laser_;
+  //both gates are tunable, so either may be the wider one
+  const double scan_gate = max(gate, birth_gate);
+  matched_.assign(num_measurements, -1);
+  near_.assign(num_measurements, 0);
+
+  if (num_tracks > 0) {
+    /***************************************************************************
+     *  Gating
+     **************************************************************************/
+    if (radar) {
+      PrepareRadar();
+    } else {
+      PrepareLaser();
+    }
+    pairs_.clear();
+    for (int m = 0; m < num_measurements; m++) {
+      const VectorXd& z = measurements[pass_[m]].raw_measurements_;
+      if (radar) {
+        DistancesRadar(z);
+      } else {
+        DistancesLaser(z);
+      }
+      //most chunks of tracks are far from the measurement; only the others are scanned
+      for (int begin = 0; begin < num_tracks; begin += kChunk) {
+        int end = min(begin + kChunk, num_tracks);
+        int scan = 0;
+        int near = 0;
+        for (int t = begin; t < end; t++) {
+          scan |= d2_[t] < scan_gate;
+          near |= d2_[t] < birth_gate;
+        }
+        if (!scan) {
+          continue;
+        }
+        near_[m] |= near;
+        for (int t = begin; t < end; t++) {
+          if (d2_[t] < gate) {
+            Pair pair = { t, m, d2_[t], 0 };
+            pairs_.push_back(pair);
+          }
+        }
+      }
+    }
+
+    /***************************************************************************
+     *  Global nearest neighbour association
+     **************************************************************************/
+    //tracks and measurements linked by gated pairs form independent clusters
+    parent_.resize(num_tracks + num_measurements);
+    for (size_t i = 0; i < parent_.size(); i++) {
+      parent_[i] = i;
+    }
+    for (size_t i = 0; i < pairs_.size(); i++) {
+      int a = Find(pairs_[i].track);
+      int b = Find(num_tracks + pairs_[i].measurement);
+      if (a != b) {
+        parent_[b] = a;
+      }
+    }
+    for (size_t i = 0; i < pairs_.size(); i++) {
+      pairs_[i].cluster = Find(pairs_[i].track);
+    }
+    sort(pairs_.begin(), pairs_.end(), [](const Pair& a, const Pair& b) { return a.cluster < b.cluster; });
+
+    local_.assign(num_tracks + num_measurements, -1);
+    size_t begin = 0;
+    while (begin < pairs_.size()) {
+      size_t end = begin + 1;
+      while (end < pairs_.size() && pairs_[end].cluster == pairs_[begin].cluster) {
+        end++;
+      }
+      SolveCluster(&pairs_[begin], end - begin, gate);
+      begin = end;
+    }
+  }
+
+  /*****************************************************************************
+   *  Update, or start a track
+   ****************************************************************************/
+  for (int m = 0; m < num_measurements; m++) {
+    const MeasurementPackage& measurement = measurements[pass_[m]];
+    int t = matched_[m];
+    if (t >= 0) {
+      UpdateTrack(t, measurement);
+      hits_[t]++;
+    } else if (near_[m]) {
+      continue;
+    } else {
+      StateVector x;
+      const VectorXd& z = measurement.raw_measurements_;
+      if (radar) {
+        x << z(0)*cos(z(1)), z(0)*sin(z(1)), 0, 0;
+      } else {
+        x << z(0), z(1), 0, 0;
+      }
+      t = AddTrack(x);
+      hits_[t] = 1;
+      TRACE_LOG("Started track " << ids_[t]);
+    }
+    updated_[t] = 1;
+    associations_[pass_[m]] = ids_[t];
+  }
+}
+
+/*
+ * Hungarian algorithm with potentials (shortest augmenting paths), O(n^2 m) for
+ * the n tracks and m measurements of the cluster. Each track has its own extra
+ * column for going without a measurement at the cost of the gate, so a pair is
+ * only used when it beats missing.
+ */
+void EKFTracker::SolveCluster(const Pair* pairs, int count, double gate) {
+  const int num_tracks = num_tracks_;
+  if (count == 1) {
+    matched_[pairs[0].measurement] = pairs[0].track;
+    return;
+  }
+
+  cluster_tracks_.clear();
+  cluster_measurements_.clear();
+  for (int i = 0; i < count; i++) {
+    if (local_[pairs[i].track] < 0) {
+      local_[pairs[i].track] = cluster_tracks_.size();
+      cluster_tracks_.push_back(pairs[i].track);
+    }
+    if (local_[num_tracks + pairs[i].measurement] < 0) {
+      local_[num_tracks + pairs[i].measurement] = cluster_measurements_.size();
+      cluster_measurements_.push_back(pairs[i].measurement);
+    }
+  }
+  const int rows = cluster_tracks_.size();
+  const int nm = cluster_measurements_.size();
+  const int cols = nm + rows;
+
+  //cost matrix, rows are tracks, columns measurements and then one miss per track
+  cost_.assign(rows * cols, kNotGated);
+  for (int i = 0; i < count; i++) {
+    cost_[local_[pairs[i].track] * cols + local_[num_tracks + pairs[i].measurement]] = pairs[i].d2;
+  }
+  for (int r = 0; r < rows; r++) {
+    cost_[r * cols + nm + r] = gate;
+  }
+
+  //1-based: row 0 and column 0 are the virtual start of the augmenting paths
+  const double inf = numeric_limits<double>::infinity();
+  u_.assign(rows + 1, 0);
+  v_.assign(cols + 1, 0);
+  p_.assign(cols + 1, 0);
+  way_.assign(cols + 1, 0);
+  for (int i = 1; i <= rows; i++) {
+    p_[0] = i;
+    int j0 = 0;
+    min_v_.assign(cols + 1, inf);
+    used_.assign(cols + 1, 0);
+    do {
+      used_[j0] = 1;
+      int i0 = p_[j0];
+      double delta = inf;
+      int j1 = 0;
+      for (int j = 1; j <= cols; j++) {
+        if (!used_[j]) {
+          double cur = cost_[(i0 - 1) * cols + j - 1] - u_[i0] - v_[j];
+          if (cur < min_v_[j]) {
+            min_v_[j] = cur;
+            way_[j] = j0;
+          }
+          if (min_v_[j] < delta) {
+            delta = min_v_[j];
+            j1 = j;
+          }
+        }
+      }
+      for (int j = 0; j <= cols; j++) {
+        if (used_[j]) {
+          u_[p_[j]] += delta;
+          v_[j] -= delta;
+        } else {
+          min_v_[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (p_[j0] != 0);
+    do {
+      int j1 = way_[j0];
+      p_[j0] = p_[j1];
+      j0 = j1;
+    } while (j0 != 0);
+  }
+
+  for (int j = 1; j <= nm; j++) {
+    if (p_[j] != 0) {
+      matched_[cluster_measurements_[j - 1]] = cluster_tracks_[p_[j] - 1];
+    }
+  }
+  for (int r = 0; r < rows; r++) {
+    local_[cluster_tracks_[r]] = -1;
+  }
+  for (int j = 0; j < nm; j++) {
+    local_[num_tracks + cluster_measurements_[j]] = -1;
+  }
+}
+
+void EKFTracker::UpdateTrack(int track, const MeasurementPackage& measurement) {
+  GetTrack(track, kf_.x_, kf_.P_);
+  if (measurement.sensor_type_ == MeasurementPackage::RADAR) {
+    tools_.CalculateJacobian(kf_.x_, Hj_);
+    Eigen::Vector3d z = measurement.raw_measurements_;
+    kf_.UpdateEKF(z, Hj_, R_radar_);
+  } else {
+    Eigen::Vector2d z = measurement.raw_measurements_;
+    kf_.Update(z, H_laser_, R_laser_);
+  }
+  for (int k = 0; k < NX; k++) {
+    x_[k * capacity_ + track] = kf_.x_(k);
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j < NX; j++) {
+      P_[(i * NX + j) * capacity_ + track] = kf_.P_(i, j);
+    }
+  }
+}
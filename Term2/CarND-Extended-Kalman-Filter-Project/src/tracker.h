@@ -0,0 +1,194 @@
+#ifndef TRACKER_H_
+#define TRACKER_H_
+
+#include "measurement_package.h"
+#include "kalman_filter.h"
+#include "tools.h"
+#include "Eigen/Dense"
+#include <vector>
+
+/**
+ * Multi-object tracker with one constant velocity EKF per track.
+ *
+ * A frame is the measurements of one sensor sweep, all at one timestamp. Every
+ * track is predicted to the frame time. The measurements are then gated against
+ * each track with the squared Mahalanobis distance y^T * S^-1 * y and
+ * associated by global nearest neighbour: gated pairs are split into independent
+ * clusters, and each cluster is solved optimally (Hungarian algorithm), where
+ * leaving a track without a measurement costs the gate. Laser and radar
+ * measurements of a frame are associated in two passes.
+ *
+ * A measurement that is not associated starts a tentative track, unless it is
+ * within the wider birth gate of a track: then it is most likely a noisy
+ * measurement of that track, and a new track would compete with it for the
+ * next measurements. A tentative track is confirmed after confirm_hits_
+ * measurements. A track is deleted when it goes
+ * more than max_misses_ frames in a row without a measurement
+ * (max_tentative_misses_ while tentative).
+ *
+ * Track states and covariances are stored structure-of-arrays: component k of
+ * track t lives at [k * capacity + t], so prediction and gating run over all
+ * tracks with the track loop innermost and vectorize. The update of an
+ * associated track is KalmanFilter's. All buffers grow with the number of
+ * tracks and measurements and are then reused, so steady-state frames do not
+ * allocate.
+ */
+class EKFTracker {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  enum { NX = 4 };
+
+  typedef KalmanFilter::StateVector StateVector;
+  typedef KalmanFilter::StateMatrix StateMatrix;
+
+  // acceleration noise variance in x and y, as in FusionEKF
+  double noise_ax_;
+  double noise_ay_;
+
+  // measurement covariance matrices
+  Eigen::Matrix2d R_laser_;
+  Eigen::Matrix3d R_radar_;
+
+  // squared Mahalanobis distance gates, by default the 99% chi-square quantiles
+  double gate_laser_;
+  double gate_radar_;
+
+  // a measurement this close to a track does not start a new one
+  double birth_gate_laser_;
+  double birth_gate_radar_;
+
+  // measurements a tentative track needs to be confirmed
+  int confirm_hits_;
+
+  // frames in a row a track may go without a measurement before it is deleted
+  int max_misses_;
+  int max_tentative_misses_;
+
+  // state covariance of a new track
+  StateMatrix P_birth_;
+
+  /**
+   * Constructor
+   */
+  EKFTracker();
+
+  /**
+   * ProcessFrame Predicts all tracks to timestamp, associates and applies the
+   * measurements and updates the track list. A frame older than the previous
+   * one is ignored.
+   * @param timestamp Time of the frame in us
+   * @param measurements Laser and/or radar measurements taken at timestamp
+   */
+  void ProcessFrame(long long timestamp, const std::vector<MeasurementPackage>& measurements);
+
+  int NumTracks() const {
+    return num_tracks_;
+  }
+
+  // Unique id of a track; indices change when tracks are deleted, ids do not
+  int TrackId(int track) const {
+    return ids_[track];
+  }
+
+  bool IsConfirmed(int track) const {
+    return hits_[track] >= confirm_hits_;
+  }
+
+  /**
+   * GetTrack Copies the state and covariance of a track
+   */
+  void GetTrack(int track, StateVector& x, StateMatrix& P) const;
+
+  /**
+   * Associations Id of the track each measurement of the last frame updated or
+   * started, -1 for neither
+   */
+  const std::vector<int>& Associations() const {
+    return associations_;
+  }
+
+private:
+  // a measurement within the gate of a track
+  struct Pair {
+    int track;
+    int measurement;
+    double d2;
+    int cluster;
+  };
+
+  long long time_us_;
+  bool has_time_;
+  int next_id_;
+
+  int num_tracks_;
+  int capacity_;
+  std::vector<double> x_;  // [NX][capacity_]
+  std::vector<double> P_;  // [NX * NX][capacity_]
+  std::vector<int> ids_;
+  std::vector<int> hits_;
+  std::vector<int> misses_;
+  std::vector<char> updated_;  // associated in the current frame
+
+  // per-track predicted measurement and inverse innovation covariance of a pass,
+  // [component][capacity_]: 3 + 6 rows for radar, 2 + 3 for laser
+  std::vector<double> z_pred_;
+  std::vector<double> S_inv_;
+  std::vector<double> d2_;  // distances of one measurement to every track
+
+  // association scratch, reused between frames
+  std::vector<int> pass_;  // indices into the frame of the measurements of a pass
+  std::vector<Pair> pairs_;
+  std::vector<int> parent_;  // union-find over tracks, then measurements
+  std::vector<int> local_;   // index of a track or measurement in its cluster
+  std::vector<int> cluster_tracks_;
+  std::vector<int> cluster_measurements_;
+  std::vector<double> cost_;
+  std::vector<double> u_, v_, min_v_;
+  std::vector<int> p_, way_;
+  std::vector<char> used_;
+  std::vector<int> matched_;  // track of each measurement of the pass, -1 if none
+  std::vector<char> near_;  // the measurement is within the birth gate of a track
+  std::vector<int> associations_;
+
+  KalmanFilter kf_;  // a track during its update
+  KalmanFilter::LaserMatrix H_laser_;
+  KalmanFilter::RadarMatrix Hj_;
+  Tools tools_;
+
+  void Reserve(int capacity);
+
+  int AddTrack(const StateVector& x);
+
+  /**
+   * RemoveTrack Drops a track; the last track moves into its index
+   */
+  void RemoveTrack(int track);
+
+  void Predict(double dt);
+
+  /**
+   * Associate Gates, associates and applies the measurements of one sensor of a
+   * frame, then starts tracks from the unassociated ones
+   */
+  void Associate(MeasurementPackage::SensorType sensor_type, const std::vector<MeasurementPackage>& measurements);
+
+  // Per-track predicted measurement and inverse innovation covariance
+  void PrepareLaser();
+  void PrepareRadar();
+
+  // Squared Mahalanobis distance of a measurement to every track, into d2_
+  void DistancesLaser(const Eigen::VectorXd& z);
+  void DistancesRadar(const Eigen::VectorXd& z);
+
+  /**
+   * SolveCluster Optimal assignment of the tracks and measurements of one cluster
+   */
+  void SolveCluster(const Pair* pairs, int count, double gate);
+
+  void UpdateTrack(int track, const MeasurementPackage& measurement);
+
+  int Find(int node);
+};
+
+#endif /* TRACKER_H_ */
@@ -0,0 +1,126 @@
+/*
+ * association_cache.cpp
+ *
+ * Per-step cache of landmark association candidates shared by the particles
+ * of one grid cell.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "association_cache.h"
+
+using namespace std;
+
+void CandidateCache::build(const ParticleStore& store, int n, const vector<LandmarkObs>& observations,
+                           const Map& map, double sensor_range, ThreadPool& pool) {
+
+    num_obs = observations.size();
+    keyed.resize(n);
+    order.resize(n);
+    slot_cell.resize(n);
+    lists.resize(pool.size());
+
+    // key every particle by its cell; 21 bits per dimension
+    pool.parallelFor(n, [&](int begin, int end, int w) {
+        for (int p = begin; p < end; p++) {
+            double heading = store.theta[p] - 2 * M_PI * floor(store.theta[p] / (2 * M_PI));
+            long long cx = (long long)floor(store.x[p] / cell_size) & 0x1FFFFF;
+            long long cy = (long long)floor(store.y[p] / cell_size) & 0x1FFFFF;
+            long long ch = (long long)floor(heading / heading_size) & 0x1FFFFF;
+            keyed[p] = make_pair((cx << 42) | (cy << 21) | ch, p);
+        }
+    });
+    sort(keyed.begin(), keyed.end());
+
+    // runs of equal keys form the cells
+    cells.clear();
+    for (int slot = 0; slot < n; slot++) {
+        order[slot] = keyed[slot].second;
+        if (slot == 0 || keyed[slot].first != keyed[slot - 1].first) {
+            Cell cell;
+            cell.begin = slot;
+            cells.push_back(cell);
+        }
+        cells.back().end = slot + 1;
+        slot_cell[slot] = cells.size() - 1;
+    }
+
+    for (unsigned w = 0; w < lists.size(); w++) {
+        lists[w].list_offsets.clear();
+        lists[w].items.clear();
+    }
+    pool.parallelFor(cells.size(), [&](int begin, int end, int w) {
+        for (int c = begin; c < end; c++) {
+            buildCell(c, w, store, observations, map, sensor_range);
+        }
+    });
+}
+
+void CandidateCache::buildCell(int c, int worker, const ParticleStore& store, const vector<LandmarkObs>& observations,
+                               const Map& map, double sensor_range) {
+
+    Cell& cell = cells[c];
+    WorkerLists& wl = lists[worker];
+    cell.worker = worker;
+    cell.offsets = wl.list_offsets.size();
+
+    // the first particle is the reference pose; bound how far the others deviate from it
+    int ref = order[cell.begin];
+    double x_ref = store.x[ref];
+    double y_ref = store.y[ref];
+    double max_offset = 0.0;
+    double max_rotation = 0.0;
+    for (int slot = cell.begin + 1; slot < cell.end; slot++) {
+        int p = order[slot];
+        max_offset = max(max_offset, dist(x_ref, y_ref, store.x[p], store.y[p]));
+        // |R(a) v - R(b) v| = 2 |sin((a - b) / 2)| |v|
+        max_rotation = max(max_rotation, 2 * fabs(sin(0.5 * (store.theta[p] - store.theta[ref]))));
+    }
+
+    // landmarks in range of at least one particle of the cell, and of all of them
+    map.query_radius(x_ref, y_ref, sensor_range + max_offset, wl.in_range);
+    double sure_range_2 = max(0.0, sensor_range - max_offset);
+    sure_range_2 *= sure_range_2;
+
+    const Map::single_landmark_s* landmarks = map.landmarks();
+    double cos_ref = cos(store.theta[ref]);
+    double sin_ref = sin(store.theta[ref]);
+    for (int o = 0; o < num_obs; o++) {
+        wl.list_offsets.push_back(wl.items.size());
+
+        double xo = observations[o].x;
+        double yo = observations[o].y;
+        double xm = x_ref + cos_ref * xo - sin_ref * yo;
+        double ym = y_ref + sin_ref * xo + cos_ref * yo;
+
+        // any particle's transformed observation lies within deviation of (xm, ym)
+        double deviation = max_offset + max_rotation * sqrt(xo * xo + yo * yo);
+
+        // nearest landmark that every particle of the cell sees
+        double min_dist = numeric_limits<double>::infinity();
+        for (unsigned k = 0; k < wl.in_range.size(); k++) {
+            const Map::single_landmark_s& landmark = landmarks[wl.in_range[k]];
+            double dx = landmark.x_f - x_ref;
+            double dy = landmark.y_f - y_ref;
+            if (dx * dx + dy * dy <= sure_range_2) {
+                min_dist = min(min_dist, dist(xm, ym, landmark.x_f, landmark.y_f));
+            }
+        }
+
+        // a particle's nearest landmark is at most min_dist + deviation from its observation,
+        // so at most min_dist + 2 * deviation from (xm, ym)
+        double bound = min_dist + 2 * deviation + 1e-9;
+        double bound_2 = bound * bound;
+        for (unsigned k = 0; k < wl.in_range.size(); k++) {
+            const Map::single_landmark_s& landmark = landmarks[wl.in_range[k]];
+            double dx = landmark.x_f - xm;
+            double dy = landmark.y_f - ym;
+            if (dx * dx + dy * dy <= bound_2) {
+                wl.items.push_back(wl.in_range[k]);
+            }
+        }
+    }
+    wl.list_offsets.push_back(wl.items.size());
+}
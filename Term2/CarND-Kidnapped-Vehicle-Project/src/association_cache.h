@@ -0,0 +1,105 @@
+/*
+ * association_cache.h
+ *
+ * Per-step cache of landmark association candidates shared by the particles
+ * of one grid cell.
+ */
+
+#ifndef ASSOCIATION_CACHE_H_
+#define ASSOCIATION_CACHE_H_
+
+#include <utility>
+#include <vector>
+
+#include "helper_functions.h"
+#include "particle_store.h"
+#include "thread_pool.h"
+
+/*
+ * Groups particles into (x, y, heading) cells and, once per cell, narrows the
+ * landmarks each observation can be associated with. For an observation the
+ * list keeps every landmark that could be the nearest in-range landmark for
+ * any particle of the cell, so scanning it gives the same association as a
+ * per-particle search. Once the filter has converged the particles fall into
+ * a handful of cells and the lists shrink to one or two landmarks.
+ */
+class CandidateCache {
+
+	struct Cell {
+		int begin;     // First slot of the cell in order
+		int end;       // One past the last slot
+		int worker;    // Worker whose buffers hold the cell's candidate lists
+		int offsets;   // Index of the cell's first list offset in that worker's list_offsets
+	};
+
+	struct WorkerLists {
+		std::vector<int> in_range;      // Landmarks in range of any particle of the current cell
+		std::vector<int> list_offsets;  // num_obs + 1 offsets into items per cell
+		std::vector<int> items;         // Candidate landmark indices
+	};
+
+	// Cell edge length [m] and heading bin width [rad]
+	double cell_size;
+	double heading_size;
+
+	int num_obs;
+
+	// (cell key, particle index), sorted so particles of a cell are adjacent
+	std::vector<std::pair<long long, int> > keyed;
+
+	std::vector<int> order;      // Particle index of each slot
+	std::vector<int> slot_cell;  // Cell of each slot
+	std::vector<Cell> cells;
+	std::vector<WorkerLists> lists;
+
+	void buildCell(int c, int worker, const ParticleStore& store, const std::vector<LandmarkObs>& observations,
+	               const Map& map, double sensor_range);
+
+public:
+
+	CandidateCache() : cell_size(2.0), heading_size(0.02), num_obs(0) {}
+
+	/**
+	 * setCellSize Sets the cell dimensions particles are grouped by.
+	 * @param position Cell edge length [m]
+	 * @param heading Heading bin width [rad]
+	 */
+	void setCellSize(double position, double heading) {
+		cell_size = position;
+		heading_size = heading;
+	}
+
+	/**
+	 * build Groups the particles and computes the candidate lists of every cell.
+	 */
+	void build(const ParticleStore& store, int n, const std::vector<LandmarkObs>& observations,
+	           const Map& map, double sensor_range, ThreadPool& pool);
+
+	/**
+	 * numCells Returns the number of occupied cells of the last build.
+	 */
+	int numCells() const {
+		return (int)cells.size();
+	}
+
+	/**
+	 * particle Returns the particle index at a slot; slots group particles by cell.
+	 */
+	int particle(int slot) const {
+		return order[slot];
+	}
+
+	/**
+	 * candidates Returns the candidate landmarks (indices into Map::landmarks()) for
+	 *   observation o of the particle at a slot.
+	 */
+	void candidates(int slot, int o, const int*& items, int& count) const {
+		const Cell& cell = cells[slot_cell[slot]];
+		const WorkerLists& wl = lists[cell.worker];
+		int first = wl.list_offsets[cell.offsets + o];
+		items = wl.items.data() + first;
+		count = wl.list_offsets[cell.offsets + o + 1] - first;
+	}
+};
+
+#endif /* ASSOCIATION_CACHE_H_ */
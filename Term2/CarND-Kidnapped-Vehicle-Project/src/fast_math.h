@@ -0,0 +1,110 @@
+/*
+ * fast_math.h
+ *
+ * Polynomial replacements for libm functions that the compiler can inline
+ * into vectorized loops.
+ */
+
+#ifndef FAST_MATH_H_
+#define FAST_MATH_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Rounds to the nearest integer with the 1.5 * 2^52 trick. Unlike floor/nearbyint
+ * this vectorizes without -fno-trapping-math. Valid for |v| < 2^51.
+ */
+inline double round_nearest(double v) {
+	const double magic = 6755399441055744.0;
+	return (v + magic) - magic;
+}
+
+/*
+ * Computes sin(t) and cos(t) together with a Cody-Waite reduction to
+ * [-pi/4, pi/4] and Cephes minimax polynomials (accurate to ~1 ulp for the
+ * headings a particle filter sees). Only arithmetic and selects, so it
+ * inlines into vectorized loops.
+ */
+inline void sincos_poly(double t, double& s, double& c) {
+
+	const double two_over_pi = 0.63661977236758134308;
+	const double pio2_1 = 1.57079625129699707031;
+	const double pio2_2 = 7.54978941586159635335e-08;
+	const double pio2_3 = 5.39030285815811905290e-15;
+
+	// quadrant and reduced argument
+	double q = round_nearest(t * two_over_pi);
+	double r = ((t - q * pio2_1) - q * pio2_2) - q * pio2_3;
+	double z = r * r;
+
+	double sr = 1.58962301576546568060e-10;
+	sr = sr * z - 2.50507477628578072866e-8;
+	sr = sr * z + 2.75573136213857245213e-6;
+	sr = sr * z - 1.98412698295895385996e-4;
+	sr = sr * z + 8.33333333332211858878e-3;
+	sr = sr * z - 1.66666666666666307295e-1;
+	sr = r + r * z * sr;
+
+	double cr = -1.13585365213876817300e-11;
+	cr = cr * z + 2.08757008419747316778e-9;
+	cr = cr * z - 2.75573141792967388112e-7;
+	cr = cr * z + 2.48015872888517045348e-5;
+	cr = cr * z - 1.38888888888730564116e-3;
+	cr = cr * z + 4.16666666666665929218e-2;
+	cr = 1.0 - 0.5 * z + z * z * cr;
+
+	// map back to the original quadrant; q is integral, so rounding q/4 - 3/8 gives floor(q/4)
+	double m = q - 4.0 * round_nearest(q * 0.25 - 0.375);
+	bool odd = (m == 1.0) || (m == 3.0);
+	double s_q = odd ? cr : sr;
+	double c_q = odd ? sr : cr;
+	s = (m >= 2.0) ? -s_q : s_q;
+	c = (m == 1.0 || m == 2.0) ? -c_q : c_q;
+}
+
+/*
+ * Natural logarithm of a positive, normal, finite v. The exponent and mantissa
+ * are split with integer bit operations (no int64 -> double conversion, which
+ * AVX2 lacks), the mantissa is folded into [sqrt(1/2), sqrt(2)) and log(m) is
+ * evaluated as 2 atanh((m - 1) / (m + 1)). Relative error is below 1e-15.
+ */
+inline double log_poly(double v) {
+
+	const double ln2 = 0.69314718055994530942;
+	const double two_52 = 4503599627370496.0;
+
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+
+	// exponent as a double: splice the biased exponent into the mantissa of 2^52
+	uint64_t e_bits = 0x4330000000000000ULL | (bits >> 52);
+	double e;
+	memcpy(&e, &e_bits, sizeof(e));
+	e = e - two_52 - 1023.0;
+
+	// mantissa in [1, 2)
+	uint64_t m_bits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+	double m;
+	memcpy(&m, &m_bits, sizeof(m));
+
+	bool high = m > 1.41421356237309504880;
+	m = high ? 0.5 * m : m;
+	e = high ? e + 1.0 : e;
+
+	double s = (m - 1.0) / (m + 1.0);
+	double z = s * s;
+	double p = 1.0 / 17.0;
+	p = p * z + 1.0 / 15.0;
+	p = p * z + 1.0 / 13.0;
+	p = p * z + 1.0 / 11.0;
+	p = p * z + 1.0 / 9.0;
+	p = p * z + 1.0 / 7.0;
+	p = p * z + 1.0 / 5.0;
+	p = p * z + 1.0 / 3.0;
+	p = p * z + 1.0;
+	return e * ln2 + 2.0 * s * p;
+}
+
+#endif /* FAST_MATH_H_ */
@@ -71,11 +71,18 @@ inline double * getError(double gt_x, double gt_y, double gt_theta, double pf_x,
 }
 
 /* Reads map data from a file.
- * @param filename Name of file containing map data.
+ * @param filename Name of file containing map data. Files ending in ".bin" are
+ *   binary maps written by map_convert and are memory-mapped instead of parsed.
  * @output True if opening and reading file was successful
  */
 inline bool read_map_data(std::string filename, Map& map) {
 
+	const std::string binary_suffix = ".bin";
+	if (filename.size() >= binary_suffix.size() &&
+	    filename.compare(filename.size() - binary_suffix.size(), binary_suffix.size(), binary_suffix) == 0) {
+		return map.load_binary(filename);
+	}
+
 	// Get file of map:
 	std::ifstream in_file_map(filename.c_str(),std::ifstream::in);
 	// Return if we can't open the file.
@@ -111,6 +118,9 @@ inline bool read_map_data(std::string filename, Map& map) {
 		// Add to landmark list of map:
 		map.landmark_list.push_back(single_landmark_temp);
 	}
+
+	// Build the spatial index used for sensor range queries
+	map.build_index();
 	return true;
 }
 
@@ -0,0 +1,172 @@
+/*
+ * localization_server.cpp
+ *
+ * Hosts one particle filter per vehicle against a shared map and runs their
+ * steps on a pool of worker threads.
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "localization_server.h"
+
+using namespace std;
+
+LocalizationServer::LocalizationServer(const Map& map, const Params& params, int num_workers,
+                                       SendFunction send, WakeFunction wake)
+    : map(map), params(params), send(send), wake(wake), steps_completed(0), stop(false) {
+
+    for (int w = 0; w < max(1, num_workers); w++) {
+        threads.push_back(thread(&LocalizationServer::workerLoop, this));
+    }
+}
+
+LocalizationServer::~LocalizationServer() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    work_cv.notify_all();
+    for (unsigned t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
+
+void LocalizationServer::onMessage(uint64_t connection, const char* data, size_t length) {
+
+    TelemetryResult result = parse_telemetry(data, length, incoming);
+    if (result == TELEMETRY_MANUAL) {
+        send(connection, "42[\"manual\",{}]");
+        return;
+    }
+    if (result != TELEMETRY_OK) {
+        return;
+    }
+
+    SessionKey key(connection, incoming.vehicle_id);
+    unique_ptr<Session>& slot = sessions[key];
+    if (!slot) {
+        // derive the seed from the key so a vehicle's run does not depend on the others
+        uint64_t seed = (connection * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)incoming.vehicle_id;
+        slot.reset(new Session(key, seed));
+        slot->pf.setKeepAssociations(params.keep_associations);
+    }
+    Session& session = *slot;
+
+    // one step in flight per vehicle, the rest wait in order
+    if (session.in_flight) {
+        session.queued.push_back(std::move(incoming));
+    } else {
+        swap(session.current, incoming);
+        submit(session);
+    }
+
+    // reuse a buffer whose observation vector already has capacity
+    if (!spare.empty()) {
+        incoming = std::move(spare.back());
+        spare.pop_back();
+    }
+}
+
+void LocalizationServer::closeConnection(uint64_t connection) {
+
+    auto it = sessions.lower_bound(SessionKey(connection, numeric_limits<long long>::min()));
+    while (it != sessions.end() && it->first.first == connection) {
+        Session& session = *it->second;
+        for (unsigned q = 0; q < session.queued.size(); q++) {
+            spare.push_back(std::move(session.queued[q]));
+        }
+        session.queued.clear();
+        if (session.in_flight) {
+            // a worker still uses it; deliver() drops the result and the session
+            session.closed = true;
+            ++it;
+        } else {
+            spare.push_back(std::move(session.current));
+            it = sessions.erase(it);
+        }
+    }
+}
+
+void LocalizationServer::deliver() {
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        delivering.swap(finished);
+    }
+
+    for (unsigned i = 0; i < delivering.size(); i++) {
+        Session& session = *delivering[i];
+        session.in_flight = false;
+        spare.push_back(std::move(session.current));
+        if (session.closed) {
+            sessions.erase(session.key);
+            continue;
+        }
+
+        send(session.key.first, session.reply);
+        steps_completed++;
+
+        if (!session.queued.empty()) {
+            session.current = std::move(session.queued.front());
+            session.queued.pop_front();
+            submit(session);
+        }
+    }
+    delivering.clear();
+}
+
+void LocalizationServer::submit(Session& session) {
+    session.in_flight = true;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        ready.push_back(&session);
+    }
+    work_cv.notify_one();
+}
+
+void LocalizationServer::workerLoop() {
+    for (;;) {
+        Session* session;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [this] { return stop || !ready.empty(); });
+            if (ready.empty()) {
+                return;
+            }
+            session = ready.front();
+            ready.pop_front();
+        }
+
+        step(*session);
+
+        // the loop thread takes all finished steps at once, so only the first one needs to wake it
+        bool first;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            first = finished.empty();
+            finished.push_back(session);
+        }
+        if (first) {
+            wake();
+        }
+    }
+}
+
+void LocalizationServer::step(Session& session) {
+
+    const Telemetry& telemetry = session.current;
+    ParticleFilter& pf = session.pf;
+
+    // the filter takes non-const arrays
+    Params p = params;
+    if (!pf.initialized()) {
+        pf.init(telemetry.sense_x, telemetry.sense_y, telemetry.sense_theta, p.sigma_pos);
+    } else {
+        pf.prediction(p.delta_t, p.sigma_pos, telemetry.previous_velocity, telemetry.previous_yawrate);
+    }
+    pf.updateWeights(p.sensor_range, p.sigma_landmark, telemetry.observations, map);
+    pf.resample();
+
+    write_best_particle(pf.particleStore(), pf.weightStats().best_index, session.reply, telemetry.vehicle_id);
+}
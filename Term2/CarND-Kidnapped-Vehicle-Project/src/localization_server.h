@@ -0,0 +1,141 @@
+/*
+ * localization_server.h
+ *
+ * Hosts one particle filter per vehicle against a shared map and runs their
+ * steps on a pool of worker threads.
+ */
+
+#ifndef LOCALIZATION_SERVER_H_
+#define LOCALIZATION_SERVER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include "particle_filter.h"
+#include "telemetry_parser.h"
+
+/*
+ * Sessions are keyed by (connection, vehicle id), so one connection can carry
+ * several vehicles. A session has at most one step in flight: its messages queue
+ * up and run in arrival order, while different sessions step in parallel. The
+ * map is only read, so all filters share it.
+ *
+ * Threading: onMessage, closeConnection and deliver must all be called from the
+ * same (event loop) thread. Workers call wake() after finishing a step; the loop
+ * thread then calls deliver(), which hands each reply to the send callback. A
+ * reply for a connection closed in the meantime is dropped.
+ */
+class LocalizationServer {
+public:
+
+	// Filter parameters shared by all vehicles
+	struct Params {
+		double delta_t;            // Time elapsed between measurements [s]
+		double sensor_range;       // Sensor range [m]
+		double sigma_pos[3];       // GPS measurement uncertainty [x [m], y [m], theta [rad]]
+		double sigma_landmark[2];  // Landmark measurement uncertainty [x [m], y [m]]
+		bool keep_associations;    // Send the best particle's debug associations
+	};
+
+	// Delivers a reply on the loop thread
+	typedef std::function<void(uint64_t connection, const std::string& message)> SendFunction;
+
+	// Asks the loop thread to call deliver(); called from worker threads
+	typedef std::function<void()> WakeFunction;
+
+	/**
+	 * Constructor
+	 * @param map Landmarks shared by all filters; must outlive the server
+	 * @param num_workers Number of threads running filter steps
+	 */
+	LocalizationServer(const Map& map, const Params& params, int num_workers, SendFunction send, WakeFunction wake);
+
+	// Destructor; waits for steps in flight
+	~LocalizationServer();
+
+	LocalizationServer(const LocalizationServer&) = delete;
+	LocalizationServer& operator=(const LocalizationServer&) = delete;
+
+	/**
+	 * onMessage Parses a websocket message of a connection and queues the step of
+	 *   its vehicle. Manual-mode messages are answered right away.
+	 */
+	void onMessage(uint64_t connection, const char* data, size_t length);
+
+	/**
+	 * closeConnection Drops the sessions of a connection, along with their queued
+	 *   messages and any result still being computed.
+	 */
+	void closeConnection(uint64_t connection);
+
+	/**
+	 * deliver Sends the replies of finished steps and starts the next queued step
+	 *   of each of those sessions.
+	 */
+	void deliver();
+
+	/**
+	 * numSessions Returns the number of vehicles currently hosted.
+	 */
+	int numSessions() const {
+		return (int)sessions.size();
+	}
+
+	/**
+	 * stepsCompleted Returns the number of filter steps delivered so far.
+	 */
+	long long stepsCompleted() const {
+		return steps_completed;
+	}
+
+private:
+
+	typedef std::pair<uint64_t, long long> SessionKey;
+
+	struct Session {
+		SessionKey key;
+		ParticleFilter pf;
+		bool in_flight;                // A step is queued or running on a worker
+		bool closed;                   // Connection went away while in flight
+		std::deque<Telemetry> queued;  // Messages waiting for the step in flight
+		Telemetry current;             // Input of the step in flight (worker-owned while in flight)
+		std::string reply;             // Output of the step in flight (worker-owned while in flight)
+
+		Session(const SessionKey& key, uint64_t seed) : key(key), pf(1, seed), in_flight(false), closed(false) {}
+	};
+
+	const Map& map;
+	Params params;
+	SendFunction send;
+	WakeFunction wake;
+
+	// Loop-thread state
+	std::map<SessionKey, std::unique_ptr<Session> > sessions;
+	std::vector<Telemetry> spare;  // Recycled message buffers
+	Telemetry incoming;
+	long long steps_completed;
+
+	// Work handed to and returned from the workers, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable work_cv;
+	std::deque<Session*> ready;
+	std::vector<Session*> finished;
+	std::vector<Session*> delivering;  // Loop-thread copy of finished
+	bool stop;
+	std::vector<std::thread> threads;
+
+	void workerLoop();
+	void step(Session& session);
+	void submit(Session& session);
+};
+
+#endif /* LOCALIZATION_SERVER_H_ */
@@ -1,34 +1,46 @@
 #include <uWS/uWS.h>
 #include <iostream>
-#include "json.hpp"
+#include <map>
+#include <memory>
+#include <thread>
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "particle_filter.h"
+#include "telemetry_parser.h"
+#include "localization_server.h"
 
 using namespace std;
 
-// for convenience
-using json = nlohmann::json;
-
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-std::string hasData(std::string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.find_first_of("]");
-  if (found_null != std::string::npos) {
-    return "";
-  }
-  else if (b1 != std::string::npos && b2 != std::string::npos) {
-    return s.substr(b1, b2 - b1 + 1);
-  }
-  return "";
-}
-
-int main()
+int main(int argc, char* argv[])
 {
   uWS::Hub h;
 
+  // --server [workers]: host one filter per connection and vehicle_id, stepped on a worker pool
+  // --debug: print weights and send the best particle's associations
+  // --map file: landmark map, text or binary (.bin)
+  // --threads n: threads stepping the single filter outside server mode
+  bool server_mode = false;
+  bool debug = false;
+  std::string map_file = "../data/map_data.txt";
+  int num_workers = (int)std::thread::hardware_concurrency();
+  int num_threads = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--server") == 0) {
+      server_mode = true;
+      if (i + 1 < argc && argv[i + 1][0] != '-') {
+        num_workers = atoi(argv[++i]);
+      }
+    } else if (strcmp(argv[i], "--debug") == 0) {
+      debug = true;
+    } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+      map_file = argv[++i];
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+    }
+  }
+
   //Set up parameters here
   double delta_t = 0.1; // Time elapsed between measurements [sec]
   double sensor_range = 50; // Sensor range [m]
@@ -38,117 +50,89 @@ int main()
 
   // Read map data
   Map map;
-  if (!read_map_data("../data/map_data.txt", map)) {
-	  cout << "Error: Could not open map file" << endl;
+  if (!read_map_data(map_file, map)) {
+	  cout << "Error: Could not open map file " << map_file << endl;
 	  return -1;
   }
 
   // Create particle filter
-  ParticleFilter pf;
+  ParticleFilter pf(num_threads);
+  pf.setKeepAssociations(debug);
+
+  // Reused by every message, so steady-state handling does not allocate
+  Telemetry telemetry;
+  std::string reply;
+
+  // Server mode: replies are computed on worker threads and sent from the event loop,
+  // which the workers wake through an async handle. The handle is declared first so
+  // it outlives the server, whose destructor joins the workers that signal it; close()
+  // hands it back to the loop, which frees it
+  struct AsyncCloser {
+    void operator()(uS::Async *a) const { a->close(); }
+  };
+  std::unique_ptr<uS::Async, AsyncCloser> async;
+  std::unique_ptr<LocalizationServer> server;
+  std::map<uint64_t, uWS::WebSocket<uWS::SERVER> > connections;
+  uint64_t next_connection = 1;
+  if (server_mode) {
+    LocalizationServer::Params params = {delta_t, sensor_range, {sigma_pos[0], sigma_pos[1], sigma_pos[2]},
+                                         {sigma_landmark[0], sigma_landmark[1]}, debug};
+    async.reset(new uS::Async(h.getLoop()));
+    uS::Async *wakeup = async.get();
+    server.reset(new LocalizationServer(map, params, num_workers,
+      [&connections](uint64_t connection, const std::string& message) {
+        // the connection may have closed while its step was running
+        auto it = connections.find(connection);
+        if (it != connections.end()) {
+          it->second.send(message.data(), message.length(), uWS::OpCode::TEXT);
+        }
+      },
+      [wakeup]() { wakeup->send(); }));
+    async->setData(server.get());
+    async->start([](uS::Async *a) { ((LocalizationServer*)a->getData())->deliver(); });
+    std::cout << "Server mode with " << num_workers << " worker(s)" << std::endl;
+  }
+
+  h.onMessage([&pf,&map,&delta_t,&sensor_range,&sigma_pos,&sigma_landmark,&debug,&telemetry,&reply,&server](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+    if (server) {
+      server->onMessage((uint64_t)(uintptr_t)ws.getUserData(), data, length);
+      return;
+    }
 
-  h.onMessage([&pf,&map,&delta_t,&sensor_range,&sigma_pos,&sigma_landmark](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
+    TelemetryResult result = parse_telemetry(data, length, telemetry);
 
-    if (length && length > 2 && data[0] == '4' && data[1] == '2')
-    {
+    if (result == TELEMETRY_OK) {
 
-      auto s = hasData(std::string(data));
-      if (s != "") {
-      	
-      	
-        auto j = json::parse(s);
-        std::string event = j[0].get<std::string>();
-        
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-
-
-          if (!pf.initialized()) {
-
-          	// Sense noisy position data from the simulator
-			double sense_x = std::stod(j[1]["sense_x"].get<std::string>());
-			double sense_y = std::stod(j[1]["sense_y"].get<std::string>());
-			double sense_theta = std::stod(j[1]["sense_theta"].get<std::string>());
-
-			pf.init(sense_x, sense_y, sense_theta, sigma_pos);
-		  }
-		  else {
-			// Predict the vehicle's next state from previous (noiseless control) data.
-		  	double previous_velocity = std::stod(j[1]["previous_velocity"].get<std::string>());
-			double previous_yawrate = std::stod(j[1]["previous_yawrate"].get<std::string>());
-
-			pf.prediction(delta_t, sigma_pos, previous_velocity, previous_yawrate);
-		  }
-
-		  // receive noisy observation data from the simulator
-		  // sense_observations in JSON format [{obs_x,obs_y},{obs_x,obs_y},...{obs_x,obs_y}]
-		  	vector<LandmarkObs> noisy_observations;
-		  	string sense_observations_x = j[1]["sense_observations_x"];
-		  	string sense_observations_y = j[1]["sense_observations_y"];
-
-		  	std::vector<float> x_sense;
-  			std::istringstream iss_x(sense_observations_x);
-
-  			std::copy(std::istream_iterator<float>(iss_x),
-        	std::istream_iterator<float>(),
-        	std::back_inserter(x_sense));
-
-        	std::vector<float> y_sense;
-  			std::istringstream iss_y(sense_observations_y);
-
-  			std::copy(std::istream_iterator<float>(iss_y),
-        	std::istream_iterator<float>(),
-        	std::back_inserter(y_sense));
-
-        	for(int i = 0; i < x_sense.size(); i++)
-        	{
-        		LandmarkObs obs;
-        		obs.x = x_sense[i];
-				obs.y = y_sense[i];
-				noisy_observations.push_back(obs);
-        	}
-
-		  // Update the weights and resample
-		  pf.updateWeights(sensor_range, sigma_landmark, noisy_observations, map);
-		  pf.resample();
-
-		  // Calculate and output the average weighted error of the particle filter over all time steps so far.
-		  vector<Particle> particles = pf.particles;
-		  int num_particles = particles.size();
-		  double highest_weight = -1.0;
-		  Particle best_particle;
-		  double weight_sum = 0.0;
-		  for (int i = 0; i < num_particles; ++i) {
-			if (particles[i].weight > highest_weight) {
-				highest_weight = particles[i].weight;
-				best_particle = particles[i];
-			}
-			weight_sum += particles[i].weight;
-		  }
-		  cout << "highest w " << highest_weight << endl;
-		  cout << "average w " << weight_sum/num_particles << endl;
-
-          json msgJson;
-          msgJson["best_particle_x"] = best_particle.x;
-          msgJson["best_particle_y"] = best_particle.y;
-          msgJson["best_particle_theta"] = best_particle.theta;
-
-          //Optional message data used for debugging particle's sensing and associations
-          msgJson["best_particle_associations"] = pf.getAssociations(best_particle);
-          msgJson["best_particle_sense_x"] = pf.getSenseX(best_particle);
-          msgJson["best_particle_sense_y"] = pf.getSenseY(best_particle);
-
-          auto msg = "42[\"best_particle\"," + msgJson.dump() + "]";
-          // std::cout << msg << std::endl;
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-	  
-        }
-      } else {
-        std::string msg = "42[\"manual\",{}]";
-        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+      if (!pf.initialized()) {
+
+        // Sense noisy position data from the simulator
+        pf.init(telemetry.sense_x, telemetry.sense_y, telemetry.sense_theta, sigma_pos);
+      }
+      else {
+        // Predict the vehicle's next state from previous (noiseless control) data.
+        pf.prediction(delta_t, sigma_pos, telemetry.previous_velocity, telemetry.previous_yawrate);
       }
+
+      // Update the weights and resample
+      pf.updateWeights(sensor_range, sigma_landmark, telemetry.observations, map);
+      pf.resample();
+
+      // The filter tracks the best particle and weight sums while updating
+      const WeightStats& stats = pf.weightStats();
+      if (debug) {
+        cout << "highest w " << stats.max_weight << endl;
+        cout << "average w " << stats.weight_sum / pf.numParticles() << endl;
+      }
+
+      // The best particle is formatted straight from the particle store
+      write_best_particle(pf.particleStore(), stats.best_index, reply);
+      ws.send(reply.data(), reply.length(), uWS::OpCode::TEXT);
+    } else if (result == TELEMETRY_MANUAL) {
+      std::string msg = "42[\"manual\",{}]";
+      ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
     }
 
   });
@@ -168,11 +152,20 @@ int main()
     }
   });
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+  h.onConnection([&h,&server,&connections,&next_connection](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    if (server) {
+      ws.setUserData((void*)(uintptr_t)next_connection);
+      connections[next_connection++] = ws;
+    }
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+  h.onDisconnection([&h,&server,&connections](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+    if (server) {
+      uint64_t connection = (uint64_t)(uintptr_t)ws.getUserData();
+      server->closeConnection(connection);
+      connections.erase(connection);
+    }
     ws.close();
     std::cout << "Disconnected" << std::endl;
   });
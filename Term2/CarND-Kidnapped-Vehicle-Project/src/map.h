@@ -8,9 +8,21 @@
 #ifndef MAP_H_
 #define MAP_H_
 
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 class Map {
 public:
-	
+
 	struct single_landmark_s{
 
 		int id_i ; // Landmark ID
@@ -20,6 +32,289 @@ public:
 
 	std::vector<single_landmark_s> landmark_list ; // List of landmarks in the map
 
+	Map() : num_cells_(0), cell_start_view_(NULL), cell_items_view_(NULL),
+	        mapped_(NULL), mapped_size_(0), mapped_landmarks_(NULL), mapped_count_(0) {}
+
+	~Map() {
+		release_mapping();
+	}
+
+	/**
+	 * size Returns the number of landmarks, from landmark_list or the mapped file.
+	 */
+	int size() const {
+		return mapped_ ? mapped_count_ : (int)landmark_list.size();
+	}
+
+	/**
+	 * landmarks Returns the landmark array; indices from query_radius refer to it.
+	 *   Points into the mapped file after load_binary, into landmark_list otherwise.
+	 */
+	const single_landmark_s* landmarks() const {
+		return mapped_ ? mapped_landmarks_ : landmark_list.data();
+	}
+
+	/**
+	 * build_index Buckets landmark_list into a uniform grid so that radius queries
+	 *   only visit the cells around the query point. Must be called again whenever
+	 *   landmark_list changes. Releases a map loaded with load_binary.
+	 * @param cell_size Edge length of a grid cell [m]
+	 */
+	void build_index(double cell_size = 50.0) {
+
+		release_mapping();
+		cell_start_.clear();
+		cell_items_.clear();
+		set_index_views();
+		if (landmark_list.empty() || cell_size <= 0.0) {
+			return;
+		}
+
+		double max_x = landmark_list[0].x_f;
+		double max_y = landmark_list[0].y_f;
+		min_x_ = max_x;
+		min_y_ = max_y;
+		for (unsigned l = 1; l < landmark_list.size(); l++) {
+			min_x_ = std::min(min_x_, (double)landmark_list[l].x_f);
+			min_y_ = std::min(min_y_, (double)landmark_list[l].y_f);
+			max_x  = std::max(max_x,  (double)landmark_list[l].x_f);
+			max_y  = std::max(max_y,  (double)landmark_list[l].y_f);
+		}
+
+		// Grow the cells for sparse maps so the grid never has many more cells than landmarks
+		const double max_cells = 4.0 * landmark_list.size() + 16.0;
+		while (((max_x - min_x_) / cell_size + 1.0) * ((max_y - min_y_) / cell_size + 1.0) > max_cells) {
+			cell_size *= 2.0;
+		}
+		cell_size_ = cell_size;
+		n_cols_ = (int)((max_x - min_x_) / cell_size_) + 1;
+		n_rows_ = (int)((max_y - min_y_) / cell_size_) + 1;
+
+		// Counting sort of landmark indices by cell (keeps map order within a cell)
+		cell_start_.assign(n_cols_ * n_rows_ + 1, 0);
+		for (unsigned l = 0; l < landmark_list.size(); l++) {
+			cell_start_[cell_of(landmark_list[l].x_f, landmark_list[l].y_f) + 1]++;
+		}
+		for (unsigned c = 1; c < cell_start_.size(); c++) {
+			cell_start_[c] += cell_start_[c - 1];
+		}
+		cell_items_.resize(landmark_list.size());
+		std::vector<int> fill(cell_start_.begin(), cell_start_.end() - 1);
+		for (unsigned l = 0; l < landmark_list.size(); l++) {
+			cell_items_[fill[cell_of(landmark_list[l].x_f, landmark_list[l].y_f)]++] = l;
+		}
+		set_index_views();
+	}
+
+	/**
+	 * query_radius Collects the landmarks within range of a point.
+	 * @param (x,y) Query position in map coordinates [m]
+	 * @param range Search radius [m]
+	 * @param out Indices into landmark_list; cleared first, its capacity is reused
+	 */
+	void query_radius(double x, double y, double range, std::vector<int>& out) const {
+
+		out.clear();
+		const double range_2 = range * range;
+		const single_landmark_s* list = landmarks();
+
+		// No index built: fall back to checking every landmark
+		if (num_cells_ == 0) {
+			for (int l = 0; l < size(); l++) {
+				if (in_range(list, l, x, y, range_2)) {
+					out.push_back(l);
+				}
+			}
+			return;
+		}
+
+		int col_lo = std::max(0, (int)floor((x - range - min_x_) / cell_size_));
+		int col_hi = std::min(n_cols_ - 1, (int)floor((x + range - min_x_) / cell_size_));
+		int row_lo = std::max(0, (int)floor((y - range - min_y_) / cell_size_));
+		int row_hi = std::min(n_rows_ - 1, (int)floor((y + range - min_y_) / cell_size_));
+
+		for (int row = row_lo; row <= row_hi; row++) {
+			for (int col = col_lo; col <= col_hi; col++) {
+				int c = row * n_cols_ + col;
+				for (int k = cell_start_view_[c]; k < cell_start_view_[c + 1]; k++) {
+					if (in_range(list, cell_items_view_[k], x, y, range_2)) {
+						out.push_back(cell_items_view_[k]);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * save_binary Writes the landmarks and the grid index built by build_index to
+	 *   a file that load_binary can map. The layout is native-endian.
+	 * @output True if the index exists and the file was written
+	 */
+	bool save_binary(const std::string& filename) const {
+
+		if (num_cells_ == 0) {
+			return false;
+		}
+		binary_header_s header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, binary_magic(), sizeof(header.magic));
+		header.version = BINARY_VERSION;
+		header.num_landmarks = size();
+		header.n_cols = n_cols_;
+		header.n_rows = n_rows_;
+		header.cell_size = cell_size_;
+		header.min_x = min_x_;
+		header.min_y = min_y_;
+
+		FILE* file = fopen(filename.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		       && fwrite(landmarks(), sizeof(single_landmark_s), size(), file) == (size_t)size()
+		       && fwrite(cell_start_view_, sizeof(int), num_cells_ + 1, file) == (size_t)num_cells_ + 1
+		       && fwrite(cell_items_view_, sizeof(int), size(), file) == (size_t)size();
+		return fclose(file) == 0 && ok;
+	}
+
+	/**
+	 * load_binary Maps a file written by save_binary read-only into memory. The
+	 *   landmarks and the grid are used in place, so loading costs no parsing and
+	 *   processes mapping the same file share its pages. landmark_list is not
+	 *   filled; use size() and landmarks().
+	 * @output True if the file was mapped and its header and grid are valid
+	 */
+	bool load_binary(const std::string& filename) {
+
+		release_mapping();
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		void* data = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(binary_header_s)) {
+			data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		// The size check also guards every offset computed below
+		const binary_header_s* header = (const binary_header_s*)data;
+		uint64_t num_cells = (uint64_t)header->n_cols * header->n_rows;
+		uint64_t expected = sizeof(binary_header_s) + header->num_landmarks * (uint64_t)sizeof(single_landmark_s)
+		                  + (num_cells + 1 + header->num_landmarks) * sizeof(int);
+		const char* base = (const char*)data + sizeof(binary_header_s);
+		const int* cell_start = (const int*)(base + header->num_landmarks * sizeof(single_landmark_s));
+		if (memcmp(header->magic, binary_magic(), sizeof(header->magic)) != 0 || header->version != BINARY_VERSION
+		    || num_cells == 0 || num_cells > INT32_MAX || header->num_landmarks > INT32_MAX
+		    || (uint64_t)st.st_size != expected || !(header->cell_size > 0.0)
+		    || cell_start[0] != 0 || cell_start[num_cells] != (int)header->num_landmarks) {
+			munmap(data, st.st_size);
+			return false;
+		}
+
+		// The queries index without checks, so the grid is validated once here:
+		// offsets must not decrease and every item must name a landmark
+		const int* cell_items = cell_start + num_cells + 1;
+		bool grid_ok = true;
+		for (uint64_t c = 0; c < num_cells && grid_ok; c++) {
+			grid_ok = cell_start[c] <= cell_start[c + 1];
+		}
+		for (uint64_t i = 0; i < header->num_landmarks && grid_ok; i++) {
+			grid_ok = cell_items[i] >= 0 && (uint64_t)cell_items[i] < header->num_landmarks;
+		}
+		if (!grid_ok) {
+			munmap(data, st.st_size);
+			return false;
+		}
+
+		mapped_ = data;
+		mapped_size_ = st.st_size;
+		mapped_landmarks_ = (const single_landmark_s*)base;
+		mapped_count_ = header->num_landmarks;
+		cell_size_ = header->cell_size;
+		min_x_ = header->min_x;
+		min_y_ = header->min_y;
+		n_cols_ = header->n_cols;
+		n_rows_ = header->n_rows;
+		num_cells_ = num_cells;
+		cell_start_view_ = cell_start;
+		cell_items_view_ = cell_items;
+		return true;
+	}
+
+private:
+
+	// Owns a mapping and views into it, so copies would dangle
+	Map(const Map&);
+	Map& operator=(const Map&);
+
+	// Binary map layout: header, landmarks, (cells + 1) cell offsets, landmark indices by cell
+	struct binary_header_s {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_landmarks;
+		uint32_t n_cols;
+		uint32_t n_rows;
+		double cell_size;
+		double min_x;
+		double min_y;
+	};
+	static const char* binary_magic() {
+		return "PFMAPBIN";
+	}
+	static const uint32_t BINARY_VERSION = 1;
+
+	double cell_size_;
+	double min_x_;
+	double min_y_;
+	int n_cols_;
+	int n_rows_;
+	std::vector<int> cell_start_; // Offset of each cell's first entry in cell_items_ (CSR layout)
+	std::vector<int> cell_items_; // Landmark indices grouped by cell
+
+	// The grid in use: cell_start_/cell_items_, or the mapped file
+	int num_cells_;
+	const int* cell_start_view_;
+	const int* cell_items_view_;
+
+	// Read-only mapping of a binary map file, if one is loaded
+	void* mapped_;
+	size_t mapped_size_;
+	const single_landmark_s* mapped_landmarks_;
+	int mapped_count_;
+
+	void set_index_views() {
+		num_cells_ = cell_start_.empty() ? 0 : (int)cell_start_.size() - 1;
+		cell_start_view_ = cell_start_.data();
+		cell_items_view_ = cell_items_.data();
+	}
+
+	void release_mapping() {
+		if (mapped_) {
+			munmap(mapped_, mapped_size_);
+			mapped_ = NULL;
+			mapped_size_ = 0;
+			mapped_landmarks_ = NULL;
+			mapped_count_ = 0;
+			set_index_views();
+		}
+	}
+
+	int cell_of(double x, double y) const {
+		int col = std::min(n_cols_ - 1, (int)((x - min_x_) / cell_size_));
+		int row = std::min(n_rows_ - 1, (int)((y - min_y_) / cell_size_));
+		return row * n_cols_ + col;
+	}
+
+	static bool in_range(const single_landmark_s* list, int l, double x, double y, double range_2) {
+		double dx = list[l].x_f - x;
+		double dy = list[l].y_f - y;
+		return dx * dx + dy * dy <= range_2;
+	}
 };
 
 
@@ -0,0 +1,51 @@
+/*
+ * map_convert.cpp
+ *
+ * Converts a text map (x y id per line) into the binary format that
+ * read_map_data memory-maps, with the grid index prebuilt.
+ *
+ * Usage: map_convert <map_data.txt> <map.bin> [cell_size]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <stdlib.h>
+#include "helper_functions.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3 || argc > 4) {
+    cerr << "Usage: " << argv[0] << " <map_data.txt> <map.bin> [cell_size]" << endl;
+    return -1;
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  Map map;
+  if (!read_map_data(argv[1], map)) {
+    cout << "Error: Could not open map file " << argv[1] << endl;
+    return -1;
+  }
+  if (argc == 4) {
+    map.build_index(atof(argv[3]));
+  }
+  if (!map.save_binary(argv[2])) {
+    cout << "Error: Could not write " << argv[2] << endl;
+    return -1;
+  }
+  double parse_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  // Map it back as a check, and to show what loading costs now
+  start = chrono::steady_clock::now();
+  Map mapped;
+  if (!mapped.load_binary(argv[2]) || mapped.size() != map.size()) {
+    cout << "Error: " << argv[2] << " does not load back" << endl;
+    return -1;
+  }
+  double load_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << "Wrote " << map.size() << " landmarks to " << argv[2] << endl;
+  cout << "Text parse + index: " << parse_time * 1e3 << " ms, binary load: " << load_time * 1e3 << " ms" << endl;
+  return 0;
+}
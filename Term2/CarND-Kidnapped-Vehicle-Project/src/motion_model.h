@@ -0,0 +1,59 @@
+/*
+ * motion_model.h
+ *
+ * Vectorizable CTRV motion update over structure-of-arrays particles.
+ *
+ * The loops below are written branch-free over __restrict pointers so the
+ * compiler can map them onto whatever vector unit the target has (SSE/AVX2 on
+ * x86, NEON on ARM). std::sin/std::cos do not vectorize, so the polynomial
+ * sincos from fast_math.h is used instead.
+ */
+
+#ifndef MOTION_MODEL_H_
+#define MOTION_MODEL_H_
+
+#include <math.h>
+
+#include "fast_math.h"
+
+/*
+ * Moves n particles with the constant turn rate and velocity model and adds
+ * the pre-drawn process noise.
+ * @param (x,y,theta) Particle poses, updated in place
+ * @param (noise_x,noise_y,noise_theta) Zero-mean noise samples, one per particle
+ * @param velocity Velocity of car from t to t+1 [m/s]
+ * @param yaw_rate Yaw rate of car from t to t+1 [rad/s]
+ * @param delta_t Time between time step t and t+1 [s]
+ */
+inline void ctrv_predict(int n, double* __restrict x, double* __restrict y, double* __restrict theta,
+                         const double* __restrict noise_x, const double* __restrict noise_y,
+                         const double* __restrict noise_theta,
+                         double velocity, double yaw_rate, double delta_t) {
+
+	// The yaw rate is shared by all particles, so the straight/turning branch is hoisted out of the loop
+	if (fabs(yaw_rate) < 1e-3) {
+		const double d = velocity * delta_t;
+		for (int i = 0; i < n; i++) {
+			double s, c;
+			sincos_poly(theta[i], s, c);
+			x[i] += d * c + noise_x[i];
+			y[i] += d * s + noise_y[i];
+			theta[i] += noise_theta[i];
+		}
+	} else {
+		// sin(theta + d_theta) and cos(theta + d_theta) expanded so only sin/cos(theta) vary per particle
+		const double k = velocity / yaw_rate;
+		const double d_theta = yaw_rate * delta_t;
+		const double sin_d = sin(d_theta);
+		const double cos_d_1 = cos(d_theta) - 1.0;
+		for (int i = 0; i < n; i++) {
+			double s, c;
+			sincos_poly(theta[i], s, c);
+			x[i] += k * (s * cos_d_1 + c * sin_d) + noise_x[i];
+			y[i] += k * (s * sin_d - c * cos_d_1) + noise_y[i];
+			theta[i] += d_theta + noise_theta[i];
+		}
+	}
+}
+
+#endif /* MOTION_MODEL_H_ */
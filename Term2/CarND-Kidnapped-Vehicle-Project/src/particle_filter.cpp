@@ -5,7 +5,6 @@
  *      Author: Tiffany Huang
  */
 
-#include <random>
 #include <algorithm>
 #include <iostream>
 #include <numeric>
@@ -18,33 +17,99 @@
 
 
 #include "particle_filter.h"
+#include "motion_model.h"
 
 using namespace std;
 
+// Nearest of the candidate landmarks to the map point (xm, ym). With check_range set, landmarks
+// farther than sqrt(range_2) from the particle at (xp, yp) are skipped. Returns nullptr if none is left.
+static inline const Map::single_landmark_s* nearestLandmark(const Map &map, const int *candidates, int count,
+        double xm, double ym, bool check_range, double xp, double yp, double range_2) {
+    const Map::single_landmark_s *landmarks = map.landmarks();
+    const Map::single_landmark_s *nearest = nullptr;
+    double min_dist_2 = numeric_limits<double>::infinity();
+    for (int k=0; k<count; k++) {
+        const Map::single_landmark_s &landmark = landmarks[candidates[k]];
+        if (check_range) {
+            double rx = landmark.x_f - xp;
+            double ry = landmark.y_f - yp;
+            if (rx*rx + ry*ry > range_2) {
+                continue;
+            }
+        }
+        double dx = xm - landmark.x_f;
+        double dy = ym - landmark.y_f;
+        double dist_2 = dx*dx + dy*dy;
+        if (dist_2 < min_dist_2) {
+            min_dist_2 = dist_2;
+            nearest = &landmark;
+        }
+    }
+    return nearest;
+}
+
+ParticleFilter::ParticleFilter(int num_threads, uint64_t seed_value)
+    : num_particles(0), initial_particles(100), is_initialized(false), association_mode(ASSOCIATE_PER_PARTICLE),
+      pool(max(1, num_threads)),
+      resampler(new SystematicResampler()), ess_threshold(0.5), carry_weights(false), last_resampled(false) {
+
+    kld.enabled = false;
+
+    workers.resize(pool.size());
+    seed(seed_value);
+    resetStats();
+    collectStats();
+}
+
+void ParticleFilter::seed(uint64_t seed_value) {
+    // one non-overlapping stream per worker, all derived from the filter seed
+    for (int w = 0; w < pool.size(); w++) {
+        workers[w].rng.seed(seed_value);
+        for (int j = 0; j < w; j++) {
+            workers[w].rng.jump();
+        }
+    }
+}
+
 void ParticleFilter::init(double x, double y, double theta, double std[]) {
     // TODO: Set the number of particles. Initialize all particles to first position (based on estimates of 
     //   x, y, theta and their uncertainties from GPS) and all weights to 1. 
     // Add random Gaussian noise to each particle.
     // NOTE: Consult particle_filter.h for more information about this method (and others in this file).
-    default_random_engine gen;
-
-    num_particles = 100;
-
-    // a normal (Gaussian) distribution
-    normal_distribution<double> dist_x(x, std[0]);
-    normal_distribution<double> dist_y(y, std[1]);
-    normal_distribution<double> dist_theta(theta, std[2]);
-    
-    for (unsigned i = 0; i < num_particles; i++) {
-        // Sample from these normal distrubtions 
-        Particle P;
-        P.id = 0;
-        P.x = dist_x(gen);
-        P.y = dist_y(gen);
-        P.theta = dist_theta(gen);     
-        particles.push_back(P);
-        weights.push_back(1.0);
+    // start with as many particles as allowed while the pose is still uncertain
+    num_particles = kld.enabled ? kld.max_particles : initial_particles;
+    int capacity = num_particles;
+
+    store.resize(num_particles);
+    resetStats();
+    pool.parallelFor(num_particles, [&](int begin, int end, int w) {
+        // Sample from normal (Gaussian) distributions around the first position
+        Rng &rng = workers[w].rng;
+        rng.fillNormal(&store.x[begin], end - begin, x, std[0]);
+        rng.fillNormal(&store.y[begin], end - begin, y, std[1]);
+        rng.fillNormal(&store.theta[begin], end - begin, theta, std[2]);
+        fill(store.weight.begin() + begin, store.weight.begin() + end, 1.0);
+        for (int i = begin; i < end; i++) {
+            accumulateStats(workers[w].stats, store, i);
+        }
+    });
+    collectStats();
+    store.reserve_associations(0);
+
+    // preallocate everything resample() touches so steps do not allocate
+    back_store.keep_associations = store.keep_associations;
+    back_store.resize(capacity);
+    ancestors.resize(capacity);
+    uniforms.resize(capacity);
+    if (kld.enabled) {
+        cdf.resize(capacity);
+        int table_size = 1;
+        while (table_size < 2 * capacity) {
+            table_size *= 2;
+        }
+        kld_bins.resize(table_size);
     }
+    carry_weights = false;
     is_initialized = true;
     //cout << "Initialised" << endl;
     //cout << "# of particles: " << particles.size() << endl;
@@ -56,33 +121,24 @@ void ParticleFilter::prediction(double delta_t, double std_pos[], double velocit
     // NOTE: When adding noise you may find std::normal_distribution and std::default_random_engine useful.
     //  http://en.cppreference.com/w/cpp/numeric/random/normal_distribution
     //  http://www.cplusplus.com/reference/random/default_random_engine/
-    default_random_engine gen;
-    normal_distribution<double> dist_x(0, std_pos[0]);
-    normal_distribution<double> dist_y(0, std_pos[1]);
-    normal_distribution<double> dist_theta(0, std_pos[2]);
-
-    for (int i = 0; i < num_particles; ++i) {
-        // Sample from these normal distrubtions
-        if (abs(yaw_rate) < 1e-3)
-        {
-            particles.at(i).x += velocity*cos(particles.at(i).theta)*delta_t;
-            particles.at(i).y += velocity*sin(particles.at(i).theta)*delta_t;
-        } else {
-            particles.at(i).x += velocity/yaw_rate*( sin(particles.at(i).theta + yaw_rate*delta_t) - sin(particles.at(i).theta));
-            particles.at(i).y += velocity/yaw_rate*(-cos(particles.at(i).theta + yaw_rate*delta_t) + cos(particles.at(i).theta));
-            particles.at(i).theta += yaw_rate*delta_t;
-        }
+    noise_x.resize(num_particles);
+    noise_y.resize(num_particles);
+    noise_theta.resize(num_particles);
 
-        // add gaussian noise
-        particles.at(i).x       += dist_x(gen);
-        particles.at(i).y       += dist_y(gen);
-        particles.at(i).theta   += dist_theta(gen);
+    pool.parallelFor(num_particles, [&](int begin, int end, int w) {
+        // draw all noise up front in bulk so the motion update runs as one vectorized pass
+        Rng &rng = workers[w].rng;
+        rng.fillNormal(&noise_x[begin], end - begin, 0.0, std_pos[0]);
+        rng.fillNormal(&noise_y[begin], end - begin, 0.0, std_pos[1]);
+        rng.fillNormal(&noise_theta[begin], end - begin, 0.0, std_pos[2]);
 
-    }
+        ctrv_predict(end - begin, &store.x[begin], &store.y[begin], &store.theta[begin],
+                     &noise_x[begin], &noise_y[begin], &noise_theta[begin], velocity, yaw_rate, delta_t);
+    });
     is_initialized = true;
 }
 
-void ParticleFilter::dataAssociation(std::vector<LandmarkObs> predicted, std::vector<LandmarkObs>& observations) {
+void ParticleFilter::dataAssociation(const std::vector<LandmarkObs> &predicted, std::vector<LandmarkObs>& observations) const {
     // TODO: Find the predicted measurement that is closest to each observed measurement and assign the 
     //   observed measurement to this particular landmark.
     // NOTE: this method will NOT be called by the grading code. But you will probably find it useful to 
@@ -91,9 +147,12 @@ void ParticleFilter::dataAssociation(std::vector<LandmarkObs> predicted, std::ve
     for (unsigned o=0; o<observations.size(); o++) {
         double min_error = numeric_limits<double>::infinity();
         for (unsigned p=0; p<predicted.size(); p++) {
-            double error = dist(predicted.at(p).x, predicted.at(p).y, observations.at(o).x, observations.at(o).y);
+            // squared distance orders the same as the distance
+            double dx = predicted[p].x - observations[o].x;
+            double dy = predicted[p].y - observations[o].y;
+            double error = dx*dx + dy*dy;
             if (error < min_error){
-                observations.at(o).id = p;
+                observations[o].id = p;
                 min_error = error;
             }
         }
@@ -114,83 +173,193 @@ void ParticleFilter::updateWeights(double sensor_range, double std_landmark[],
     //   3.33
     //   http://planning.cs.uiuc.edu/node99.html
     //   
-    double gauss_norm = 1/(2 * M_PI * std_landmark[0] * std_landmark[1]);
-    double var_x = std_landmark[0]*std_landmark[0];
-    double var_y = std_landmark[1]*std_landmark[1];
-
-    for (unsigned p=0; p<num_particles; p++) {
-        double xp =  particles.at(p).x;
-        double yp =  particles.at(p).y;
-        double thetap =  particles.at(p).theta;
-        std::vector<LandmarkObs> p_observations;
-        for (unsigned o=0; o<observations.size(); o++) {
-            double xo =  observations.at(o).x;
-            double yo =  observations.at(o).y;
-
-            LandmarkObs transform_obs;
-            // transform to map x coordinate
-            transform_obs.x = xp + (cos(thetap) * xo) - (sin(thetap) * yo);
-            // transform to map y coordinate
-            transform_obs.y = yp + (sin(thetap) * xo) + (cos(thetap) * yo);
-
-            transform_obs.id = observations.at(o).id;
-            p_observations.push_back(transform_obs);
-        } // particle's observation in map coordiantes
-
-        // calculate predicted psuedo ranges from particle location to 
-        std::vector<LandmarkObs> predictions;
-
-        for (unsigned l=0; l<map_landmarks.landmark_list.size(); l++) {
-            int l_id = map_landmarks.landmark_list.at(l).id_i;
-            double l_x = map_landmarks.landmark_list.at(l).x_f;
-            double l_y = map_landmarks.landmark_list.at(l).y_f;
-            if (dist(l_x, l_y, xp, yp) <= sensor_range) {
-                LandmarkObs predicted;
-                predicted.id = l_id;
-                predicted.x  = l_x;
-                predicted.y  = l_y;
-                predictions.push_back(predicted);
+    // log of the bivariate Gaussian normalizer; weights are accumulated as log-likelihoods
+    // so products over many observations cannot underflow
+    double log_gauss_norm = -log(2 * M_PI * std_landmark[0] * std_landmark[1]);
+    double inv_2var_x = 1 / (2 * std_landmark[0] * std_landmark[0]);
+    double inv_2var_y = 1 / (2 * std_landmark[1] * std_landmark[1]);
+    const double neg_inf = -numeric_limits<double>::infinity();
+    const int num_obs = observations.size();
+
+    const double range_2 = sensor_range * sensor_range;
+    const bool use_cache = association_mode == ASSOCIATE_CELL_CACHE;
+
+    store.reserve_associations(num_obs);
+    log_weights.resize(num_particles);
+    if (use_cache) {
+        cache.build(store, num_particles, observations, map_landmarks, sensor_range, pool);
+    }
+
+    // workers left without particles are not called and keep their slots at these values
+    for (int w = 0; w < pool.size(); w++) {
+        workers[w].partial = neg_inf;
+    }
+    pool.parallelFor(num_particles, [&](int begin, int end, int w) {
+        // landmarks in sensor range of the current particle, reused across particles and steps
+        std::vector<int> &nearby = workers[w].nearby;
+        double max_log_weight = neg_inf;
+
+        for (int slot=begin; slot<end; slot++) {
+            // the cache orders particles by cell so neighbours share its candidate lists
+            int p = use_cache ? cache.particle(slot) : slot;
+            double xp =  store.x[p];
+            double yp =  store.y[p];
+            double cos_p = cos(store.theta[p]);
+            double sin_p = sin(store.theta[p]);
+
+            const int *candidates = nullptr;
+            int num_candidates = 0;
+            if (!use_cache) {
+                map_landmarks.query_radius(xp, yp, sensor_range, nearby);
+                if (nearby.empty() && num_obs > 0) {
+                    log_weights[p] = neg_inf;
+                    continue;
+                }
+                candidates = nearby.data();
+                num_candidates = nearby.size();
             }
-        } // created predictions
-        if (predictions.size() > 0)
-        {
-            // associatation using nearest neighbour
-            dataAssociation(predictions, p_observations);
-
-            //  update weight
-            std::vector<int> associations;
-            std::vector<double> sense_x;
-            std::vector<double> sense_y;
-            // init weight 
-            particles.at(p).weight = 1.0;
-            
-            for (unsigned i=0; i<observations.size(); i++) {
-                int id_o = p_observations.at(i).id;
-                associations.push_back(predictions.at(id_o).id);
-                sense_x.push_back(p_observations.at(i).x);
-                sense_y.push_back(p_observations.at(i).y);
-                double dx = (p_observations.at(i).x - predictions.at(id_o).x);
-                double dy = (p_observations.at(i).y - predictions.at(id_o).y);
-                double exponent= (dx*dx)/(2 * var_x) + (dy*dy)/(2 * var_y);
-                // //cout << "dx " << dx << endl;
-                // //cout << "dy " << dy << endl;
-                // //cout << "varx " << var_x << endl;
-                // //cout << "vary " << var_y << endl;
-                // //cout << "exponent " << exponent << endl;
-                // //cout << "gauss_norm " << gauss_norm << endl;
-                particles.at(p).weight *= gauss_norm * exp(-exponent);
-            } // loop through associated observations
-            weights.at(p) = particles.at(p).weight;
-            // set associations for visualisation 
-            particles.at(p) = SetAssociations(particles.at(p), associations, sense_x, sense_y);
+
+            // continue from the previous weight if the last resample was skipped
+            double log_weight = carry_weights ? log(store.weight[p]) : 0.0;
+
+            for (int o=0; o<num_obs; o++) {
+                // transform the observation to map coordinates
+                double xm = xp + (cos_p * observations[o].x) - (sin_p * observations[o].y);
+                double ym = yp + (sin_p * observations[o].x) + (cos_p * observations[o].y);
+
+                // associate with the nearest landmark in range
+                if (use_cache) {
+                    cache.candidates(slot, o, candidates, num_candidates);
+                }
+                const Map::single_landmark_s *nearest = nearestLandmark(map_landmarks, candidates, num_candidates,
+                                                                        xm, ym, use_cache, xp, yp, range_2);
+                if (nearest == nullptr) {
+                    // no landmark in sensor range of this particle
+                    log_weight = neg_inf;
+                    break;
+                }
+
+                // score the pair
+                double dx = xm - nearest->x_f;
+                double dy = ym - nearest->y_f;
+                log_weight += log_gauss_norm - (dx*dx*inv_2var_x + dy*dy*inv_2var_y);
+
+                // set associations for visualisation 
+                store.add_association(p, nearest->id_i, xm, ym);
+            } // loop through observations
+
+            log_weights[p] = log_weight;
+            max_log_weight = max(max_log_weight, log_weight);
+        } // loop through particles
+        workers[w].partial = max_log_weight;
+    });
+
+    normalizeWeights();
+}
+
+void ParticleFilter::normalizeWeights() {
+
+    // log-sum-exp: shift by the largest log weight before exponentiating
+    const double neg_inf = -numeric_limits<double>::infinity();
+    double max_log_weight = neg_inf;
+    for (int w = 0; w < pool.size(); w++) {
+        max_log_weight = max(max_log_weight, workers[w].partial);
+    }
+    if (max_log_weight == neg_inf) {
+        // no particle has a landmark in range
+        fill(store.weight.begin(), store.weight.end(), 0.0);
+        resetStats();
+        collectStats();
+        return;
+    }
+
+    for (int w = 0; w < pool.size(); w++) {
+        workers[w].partial = 0.0;
+    }
+    pool.parallelFor(num_particles, [&](int begin, int end, int w) {
+        double sum = 0.0;
+        for (int p = begin; p < end; p++) {
+            store.weight[p] = exp(log_weights[p] - max_log_weight);
+            sum += store.weight[p];
         }
-        else
-        {
-          particles.at(p).weight = 0.0;
-          weights.at(p) = 0.0;  
+        workers[w].partial = sum;
+    });
+    double total = 0.0;
+    for (int w = 0; w < pool.size(); w++) {
+        total += workers[w].partial;
+    }
+
+    // the scaling pass also gathers the weight statistics
+    double scale = 1.0 / total;
+    resetStats();
+    pool.parallelFor(num_particles, [&](int begin, int end, int w) {
+        StatsPartial &acc = workers[w].stats;
+        for (int p = begin; p < end; p++) {
+            store.weight[p] *= scale;
+            accumulateStats(acc, store, p);
+        }
+    });
+    collectStats();
+}
+
+void ParticleFilter::resetStats() {
+    for (int w = 0; w < pool.size(); w++) {
+        StatsPartial &acc = workers[w].stats;
+        acc.best_index = -1;
+        acc.max_weight = -numeric_limits<double>::infinity();
+        acc.sum = acc.sum_sq = 0.0;
+        acc.sum_x = acc.sum_y = acc.sum_cos = acc.sum_sin = 0.0;
+    }
+}
+
+void ParticleFilter::accumulateStats(StatsPartial& acc, const ParticleStore& particles, int p) {
+    double weight = particles.weight[p];
+    if (weight > acc.max_weight) {
+        acc.max_weight = weight;
+        acc.best_index = p;
+    }
+    double s, c;
+    sincos_poly(particles.theta[p], s, c);
+    acc.sum += weight;
+    acc.sum_sq += weight * weight;
+    acc.sum_x += weight * particles.x[p];
+    acc.sum_y += weight * particles.y[p];
+    acc.sum_cos += weight * c;
+    acc.sum_sin += weight * s;
+}
+
+void ParticleFilter::collectStats() {
+
+    // combine in worker order so the result does not depend on timing
+    StatsPartial total = workers[0].stats;
+    for (int w = 1; w < pool.size(); w++) {
+        const StatsPartial &acc = workers[w].stats;
+        if (acc.max_weight > total.max_weight) {
+            total.max_weight = acc.max_weight;
+            total.best_index = acc.best_index;
         }
-        //cout << "p[" << p<< "], weight =" << weights.at(p) << endl;
-    } // loop through particles
+        total.sum += acc.sum;
+        total.sum_sq += acc.sum_sq;
+        total.sum_x += acc.sum_x;
+        total.sum_y += acc.sum_y;
+        total.sum_cos += acc.sum_cos;
+        total.sum_sin += acc.sum_sin;
+    }
+
+    stats.best_index = max(0, total.best_index);
+    stats.max_weight = max(0.0, total.max_weight);
+    stats.weight_sum = total.sum;
+    stats.ess = total.sum_sq > 0.0 ? total.sum * total.sum / total.sum_sq : 0.0;
+    if (total.sum > 0.0) {
+        stats.mean_x = total.sum_x / total.sum;
+        stats.mean_y = total.sum_y / total.sum;
+        stats.mean_theta = atan2(total.sum_sin, total.sum_cos);
+    } else {
+        // no weight anywhere: fall back to the first particle
+        stats.mean_x = num_particles > 0 ? store.x[0] : 0.0;
+        stats.mean_y = num_particles > 0 ? store.y[0] : 0.0;
+        stats.mean_theta = num_particles > 0 ? store.theta[0] : 0.0;
+    }
 }
 
 void ParticleFilter::resample() {
@@ -199,16 +368,123 @@ void ParticleFilter::resample() {
     // TODO: Resample particles with replacement with probability proportional to their weight. 
     // NOTE: You may find std::discrete_distribution helpful here.
     //   http://en.cppreference.com/w/cpp/numeric/random/discrete_distribution
-    default_random_engine gen;
-    vector<Particle> re_particles; //resample
+    last_resampled = false;
+    double ess = effectiveSampleSize();
+    if (!(ess > 0.0)) {
+        // no particle explains the observations; keep the set and start the next update afresh
+        carry_weights = false;
+        return;
+    }
+    if (ess >= ess_threshold * num_particles) {
+        // weights are still well spread, keep accumulating them
+        carry_weights = true;
+        return;
+    }
 
-    discrete_distribution<int> weight_dist(weights.begin(), weights.end());
+    int new_count = num_particles;
+    if (kld.enabled) {
+        new_count = drawKld();
+    } else {
+        workers[0].rng.fillUniform(uniforms.data(), resampler->uniformsNeeded(num_particles));
+        resampler->resample(store.weight.data(), num_particles, uniforms.data(), ancestors.data());
+    }
 
-    for (unsigned p=0; p<num_particles; p++) {
+    // gather into the back buffer, then swap it to the front; the resampled set
+    // represents the posterior with equal weights
+    int best_ancestor = stats.best_index;
+    double uniform_weight = 1.0 / new_count;
+    back_store.keep_associations = store.keep_associations;
+    back_store.assoc_stride = store.assoc_stride;
+    back_store.resize(new_count);
+    num_particles = new_count;
+    resetStats();
+    pool.parallelFor(num_particles, [&](int begin, int end, int w) {
+        StatsPartial &acc = workers[w].stats;
+        for (int p = begin; p < end; p++) {
+            back_store.copy_particle(store, ancestors[p], p);
+            back_store.weight[p] = uniform_weight;
+            accumulateStats(acc, back_store, p);
+        }
+    });
+    swap(store, back_store);
+    collectStats();
 
-            re_particles.push_back(particles.at(weight_dist(gen)));
+    // equal weights single out no particle: report a copy of the one that was best before
+    const int *copy = find(ancestors.data(), ancestors.data() + num_particles, best_ancestor);
+    if (copy != ancestors.data() + num_particles) {
+        stats.best_index = (int)(copy - ancestors.data());
+    }
+
+    carry_weights = false;
+    last_resampled = true;
+}
+
+int ParticleFilter::drawKld() {
+
+    // cumulative weights for inverse-CDF sampling
+    double total = 0.0;
+    for (int p = 0; p < num_particles; p++) {
+        total += store.weight[p];
+        cdf[p] = total;
+    }
+
+    // open-addressing set of occupied (x, y, theta) bins
+    const long long empty = -1;
+    const unsigned long long mask = kld_bins.size() - 1;
+    fill(kld_bins.begin(), kld_bins.end(), empty);
+
+    Rng &rng = workers[0].rng;
+
+    int drawn = 0;
+    int occupied = 0;
+    int required = kld.min_particles;
+    while (drawn < kld.max_particles && (drawn < required || drawn < kld.min_particles)) {
+        int ancestor = upper_bound(cdf.begin(), cdf.begin() + num_particles, total * rng.uniform()) - cdf.begin();
+        ancestor = min(ancestor, num_particles - 1);
+        ancestors[drawn++] = ancestor;
+
+        double heading = store.theta[ancestor] - 2 * M_PI * floor(store.theta[ancestor] / (2 * M_PI));
+        long long bx = (long long)floor(store.x[ancestor] / kld.bin_xy) & 0x1FFFFF;
+        long long by = (long long)floor(store.y[ancestor] / kld.bin_xy) & 0x1FFFFF;
+        long long bt = (long long)floor(heading / kld.bin_theta) & 0x1FFFFF;
+        long long key = (bx << 42) | (by << 21) | bt;
+
+        unsigned long long slot = ((unsigned long long)key * 0x9E3779B97F4A7C15ULL) >> 20 & mask;
+        while (kld_bins[slot] != empty && kld_bins[slot] != key) {
+            slot = (slot + 1) & mask;
+        }
+        if (kld_bins[slot] == empty) {
+            kld_bins[slot] = key;
+            occupied++;
+            if (occupied > 1) {
+                // samples needed so the KL divergence to the true posterior stays below epsilon
+                // with probability 1 - delta (Fox 2003)
+                double k = occupied - 1;
+                double a = 2.0 / (9.0 * k);
+                double c = 1.0 - a + sqrt(a) * kld.z;
+                required = (int)ceil(k / (2.0 * kld.epsilon) * c * c * c);
+            }
         }
-    particles = move(re_particles);
+    }
+    return drawn;
+}
+
+Particle ParticleFilter::getParticle(int i) const
+{
+    Particle particle;
+    particle.id = i;
+    particle.x = store.x[i];
+    particle.y = store.y[i];
+    particle.theta = store.theta[i];
+    particle.weight = store.weight[i];
+    if (store.keep_associations) {
+        int slot = i * store.assoc_stride;
+        int count = store.assoc_count[i];
+        particle.associations.assign(store.associations.begin() + slot, store.associations.begin() + slot + count);
+        particle.sense_x.assign(store.sense_x.begin() + slot, store.sense_x.begin() + slot + count);
+        particle.sense_y.assign(store.sense_y.begin() + slot, store.sense_y.begin() + slot + count);
+    }
+    return particle;
 }
 
 Particle ParticleFilter::SetAssociations(Particle& particle, const std::vector<int>& associations, 
@@ -10,6 +10,13 @@
 #define PARTICLE_FILTER_H_
 
 #include "helper_functions.h"
+#include "particle_store.h"
+#include "thread_pool.h"
+#include "resampler.h"
+#include "association_cache.h"
+#include "rng.h"
+
+#include <memory>
 
 struct Particle {
 
@@ -25,27 +32,134 @@ struct Particle {
 
 
 
+/*
+ * Summary of the particle weights, kept up to date as a by-product of init,
+ * updateWeights and resample.
+ */
+struct WeightStats {
+
+	int best_index;     // Particle with the highest weight
+	double max_weight;
+	double weight_sum;
+	double ess;         // Effective sample size, (sum w)^2 / sum w^2
+	double mean_x;      // Weighted mean pose [m]
+	double mean_y;
+	double mean_theta;  // Weighted circular mean [rad]
+};
+
 class ParticleFilter {
+public:
+
+	// How updateWeights finds the landmark candidates of an observation
+	enum AssociationMode {
+		ASSOCIATE_PER_PARTICLE,  // grid query per particle, every in-range landmark is a candidate
+		ASSOCIATE_CELL_CACHE     // candidate lists computed once per cell of nearby particles
+	};
+
+private:
 	
 	// Number of particles to draw
 	int num_particles; 
+
+	// Number of particles init draws when the count is fixed
+	int initial_particles;
+
+	// KLD-sampling settings
+	struct KldConfig {
+		bool enabled;
+		int min_particles;
+		int max_particles;
+		double epsilon;    // Bound on the KL divergence between sample and true posterior
+		double z;          // Upper 1 - delta quantile of the standard normal
+		double bin_xy;     // Histogram bin size in x and y [m]
+		double bin_theta;  // Histogram bin size in yaw [rad]
+	} kld;
 	
 	
 	
 	// Flag, if filter is initialized
 	bool is_initialized;
 	
-	// Vector of weights of all particles
-	std::vector<double> weights;
+	// Set of current particles
+	ParticleStore store;
+
+	// Process noise samples for one prediction step, one per particle
+	std::vector<double> noise_x;
+	std::vector<double> noise_y;
+	std::vector<double> noise_theta;
+
+	// Association strategy and the cache used by ASSOCIATE_CELL_CACHE
+	AssociationMode association_mode;
+	CandidateCache cache;
+
+	// Unnormalized log weights of the last update
+	std::vector<double> log_weights;
+
+	// Running sums for WeightStats over one worker's range
+	struct StatsPartial {
+		int best_index;
+		double max_weight;
+		double sum;
+		double sum_sq;
+		double sum_x;
+		double sum_y;
+		double sum_cos;
+		double sum_sin;
+	};
+
+	// Per-worker random stream, scratch buffer and reduction slots
+	struct WorkerState {
+		Rng rng;
+		std::vector<int> nearby;
+		double partial;
+		StatsPartial stats;
+	};
+	std::vector<WorkerState> workers;
+
+	// Workers that split the particle range in init, prediction and updateWeights
+	ThreadPool pool;
+
+	// Buffer the resampled particles are gathered into; swapped with store afterwards
+	ParticleStore back_store;
+
+	// Resampling scheme and its preallocated inputs/outputs
+	std::unique_ptr<Resampler> resampler;
+	std::vector<int> ancestors;
+	std::vector<double> uniforms;
+
+	// Resample only when the effective sample size drops below this fraction of the particles
+	double ess_threshold;
+
+	// Flag, if the current weights carry into the next update (last resample was skipped)
+	bool carry_weights;
+
+	// Flag, if the last call to resample() replaced the particle set
+	bool last_resampled;
+
+	// Cumulative weights and occupied-bin hash table used by KLD-sampling
+	std::vector<double> cdf;
+	std::vector<long long> kld_bins;
+
+	// Weight summary of the current particle set
+	WeightStats stats;
+
+	// Turns log_weights into normalized weights with log-sum-exp
+	void normalizeWeights();
+
+	// Clears the per-worker sums, adds particle p of a store to them, and combines them into stats
+	void resetStats();
+	static void accumulateStats(StatsPartial& acc, const ParticleStore& particles, int p);
+	void collectStats();
+
+	// Draws ancestors until the KLD bound for the occupied bins is met; returns the new count
+	int drawKld();
 	
 public:
-	
-	// Set of current particles
-	std::vector<Particle> particles;
 
 	// Constructor
-	// @param num_particles Number of particles
-	ParticleFilter() : num_particles(0), is_initialized(false) {}
+	// @param num_threads Number of worker threads, including the calling thread
+	// @param seed Seed of the random streams; results are reproducible for a fixed seed and thread count
+	explicit ParticleFilter(int num_threads = 1, uint64_t seed = 1);
 
 	// Destructor
 	~ParticleFilter() {}
@@ -78,11 +192,26 @@ public:
 	 * @param predicted Vector of predicted landmark observations
 	 * @param observations Vector of landmark observations
 	 */
-	void dataAssociation(std::vector<LandmarkObs> predicted, std::vector<LandmarkObs>& observations);
+	void dataAssociation(const std::vector<LandmarkObs> &predicted, std::vector<LandmarkObs>& observations) const;
+
+	/**
+	 * setAssociationMode Selects how updateWeights gathers association candidates.
+	 *   Both modes associate every observation with the same landmark; the cell cache
+	 *   is much cheaper once particles have clustered.
+	 * @param mode Association strategy
+	 * @param cell_size Edge length [m] of the cells particles are grouped by (cell cache only)
+	 * @param heading_size Heading bin width [rad] of the cells (cell cache only)
+	 */
+	void setAssociationMode(AssociationMode mode, double cell_size = 2.0, double heading_size = 0.02) {
+		association_mode = mode;
+		cache.setCellSize(cell_size, heading_size);
+	}
 	
 	/**
 	 * updateWeights Updates the weights for each particle based on the likelihood of the 
-	 *   observed measurements. 
+	 *   observed measurements. Each particle's observations are transformed, associated
+	 *   and scored in a single pass in the log domain; the weights are then normalized to
+	 *   sum to 1. 
 	 * @param sensor_range Range [m] of sensor
 	 * @param std_landmark[] Array of dimension 2 [Landmark measurement uncertainty [x [m], y [m]]]
 	 * @param observations Vector of landmark observations
@@ -93,10 +222,89 @@ public:
 	
 	/**
 	 * resample Resamples from the updated set of particles to form
-	 *   the new set of particles.
+	 *   the new set of particles. Skipped while the effective sample size stays
+	 *   above the configured threshold; the weights then carry into the next update.
 	 */
 	void resample();
 
+	/**
+	 * seed Restarts the random streams from seed. Worker w draws from the
+	 *   stream jumped w times ahead, so workers never overlap.
+	 */
+	void seed(uint64_t seed_value);
+
+	/**
+	 * setNumParticles Uses a fixed particle count (100 by default). Call before init.
+	 */
+	void setNumParticles(int n) {
+		initial_particles = n;
+		kld.enabled = false;
+	}
+
+	/**
+	 * setAdaptiveParticles Enables KLD-sampling: every resample draws just enough
+	 *   particles for the posterior spread, between min_particles and max_particles.
+	 *   init starts from max_particles. Call before init.
+	 * @param epsilon Bound on the KL divergence of the sample-based posterior
+	 * @param z Upper 1 - delta quantile of the standard normal (2.326 for delta = 0.01)
+	 * @param bin_xy Histogram bin size in x and y [m]
+	 * @param bin_theta Histogram bin size in yaw [rad]
+	 */
+	void setAdaptiveParticles(int min_particles, int max_particles, double epsilon = 0.05, double z = 2.326,
+	                          double bin_xy = 0.5, double bin_theta = 0.1) {
+		kld.enabled = true;
+		kld.min_particles = std::max(1, min_particles);
+		kld.max_particles = std::max(kld.min_particles, max_particles);
+		kld.epsilon = epsilon;
+		kld.z = z;
+		kld.bin_xy = bin_xy;
+		kld.bin_theta = bin_theta;
+	}
+
+	/**
+	 * setResampler Replaces the resampling scheme (systematic by default). Not used
+	 *   while KLD-sampling is enabled.
+	 */
+	void setResampler(std::unique_ptr<Resampler> scheme) {
+		resampler = std::move(scheme);
+	}
+
+	/**
+	 * setEssThreshold Sets the fraction of the particle count below which the
+	 *   effective sample size triggers resampling. 1.0 resamples on every step
+	 *   unless all weights are equal; 0.5 is the default.
+	 */
+	void setEssThreshold(double fraction) {
+		ess_threshold = fraction;
+	}
+
+	/**
+	 * effectiveSampleSize Returns (sum w)^2 / sum w^2 of the current weights.
+	 */
+	double effectiveSampleSize() const {
+		return stats.ess;
+	}
+
+	/**
+	 * weightStats Returns the highest-weight particle, weight sum, effective sample
+	 *   size and weighted mean pose of the current particles. Computed within the
+	 *   passes of init, updateWeights and resample, so querying it costs nothing;
+	 *   prediction moves the particles without updating the mean pose. After a
+	 *   resample the weights are equal, so the ESS is the particle count, the mean
+	 *   is the plain mean, and best_index is a copy of the particle that had the
+	 *   highest weight before.
+	 */
+	const WeightStats& weightStats() const {
+		return stats;
+	}
+
+	/**
+	 * resampled Returns whether the last call to resample() replaced the particles.
+	 */
+	bool resampled() const {
+		return last_resampled;
+	}
+
 	/*
 	 * Set a particles list of associations, along with the associations calculated world x,y coordinates
 	 * This can be a very useful debugging tool to make sure transformations are correct and assocations correctly connected
@@ -105,6 +313,41 @@ public:
 		                     const std::vector<double>& sense_x, const std::vector<double>& sense_y);
 
 	
+	/**
+	 * getParticle Returns a copy of particle i, including its debug associations.
+	 */
+	Particle getParticle(int i) const;
+
+	/**
+	 * numParticles Returns the number of particles currently in the filter.
+	 */
+	int numParticles() const {
+		return store.size();
+	}
+
+	/**
+	 * numThreads Returns the number of workers used per step.
+	 */
+	int numThreads() const {
+		return pool.size();
+	}
+
+	/**
+	 * particleStore Read-only access to the structure-of-arrays particle set.
+	 */
+	const ParticleStore& particleStore() const {
+		return store;
+	}
+
+	/**
+	 * setKeepAssociations Enables or disables recording of per-particle debug
+	 *   associations (getAssociations/getSenseX/getSenseY). Off by default, as
+	 *   recording costs a store per observation and particle. Call before init.
+	 */
+	void setKeepAssociations(bool keep) {
+		store.keep_associations = keep;
+	}
+
 	std::string getAssociations(Particle best);
 	std::string getSenseX(Particle best);
 	std::string getSenseY(Particle best);
@@ -0,0 +1,104 @@
+/*
+ * particle_store.h
+ *
+ * Structure-of-arrays storage for the particle set.
+ */
+
+#ifndef PARTICLE_STORE_H_
+#define PARTICLE_STORE_H_
+
+#include <vector>
+#include <algorithm>
+
+struct ParticleStore {
+
+	// Pose and weight of each particle, one contiguous array per component
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> theta;
+	std::vector<double> weight;
+
+	// Flag, if per-particle debug associations are recorded
+	bool keep_associations;
+
+	// Debug associations, stored flat with assoc_stride slots per particle
+	int assoc_stride;
+	std::vector<int> assoc_count;
+	std::vector<int> associations;
+	std::vector<double> sense_x;
+	std::vector<double> sense_y;
+
+	ParticleStore() : keep_associations(false), assoc_stride(0) {}
+
+	int size() const {
+		return (int)x.size();
+	}
+
+	/**
+	 * resize Sets the number of particles. Capacity is kept, so shrinking and
+	 *   regrowing within the previous maximum does not allocate.
+	 */
+	void resize(int n) {
+		x.resize(n);
+		y.resize(n);
+		theta.resize(n);
+		weight.resize(n);
+		if (keep_associations) {
+			assoc_count.resize(n, 0);
+			associations.resize(n * assoc_stride);
+			sense_x.resize(n * assoc_stride);
+			sense_y.resize(n * assoc_stride);
+		}
+	}
+
+	/**
+	 * reserve_associations Makes room for up to stride associations per particle
+	 *   and clears the recorded ones.
+	 */
+	void reserve_associations(int stride) {
+		if (!keep_associations) {
+			return;
+		}
+		if (stride > assoc_stride) {
+			assoc_stride = stride;
+		}
+		resize(size());
+		std::fill(assoc_count.begin(), assoc_count.end(), 0);
+	}
+
+	/**
+	 * add_association Records one observation of particle i associated with a
+	 *   landmark, along with the observation in map coordinates.
+	 */
+	void add_association(int i, int landmark_id, double map_x, double map_y) {
+		if (!keep_associations || assoc_count[i] >= assoc_stride) {
+			return;
+		}
+		int slot = i * assoc_stride + assoc_count[i]++;
+		associations[slot] = landmark_id;
+		sense_x[slot] = map_x;
+		sense_y[slot] = map_y;
+	}
+
+	/**
+	 * copy_particle Copies particle from of src into slot to of this store.
+	 */
+	void copy_particle(const ParticleStore& src, int from, int to) {
+		x[to] = src.x[from];
+		y[to] = src.y[from];
+		theta[to] = src.theta[from];
+		weight[to] = src.weight[from];
+		if (keep_associations && src.keep_associations) {
+			int count = std::min(src.assoc_count[from], assoc_stride);
+			int src_slot = from * src.assoc_stride;
+			int dst_slot = to * assoc_stride;
+			assoc_count[to] = count;
+			std::copy(src.associations.data() + src_slot, src.associations.data() + src_slot + count,
+			          associations.data() + dst_slot);
+			std::copy(src.sense_x.data() + src_slot, src.sense_x.data() + src_slot + count, sense_x.data() + dst_slot);
+			std::copy(src.sense_y.data() + src_slot, src.sense_y.data() + src_slot + count, sense_y.data() + dst_slot);
+		}
+	}
+};
+
+#endif /* PARTICLE_STORE_H_ */
@@ -0,0 +1,168 @@
+/*
+ * replay.cpp
+ *
+ * Offline driver: streams recorded control, observation and ground truth files
+ * through the particle filter without the simulator, and reports per-stage
+ * timing and accuracy.
+ *
+ * Usage: particle_filter_replay [data_dir] [--map file] [--particles n]
+ *                               [--threads n] [--seed s]
+ *
+ * data_dir holds control_data.txt, gt_data.txt and observation/observations_%06d.txt
+ * (one file per step, numbered from 1); the map defaults to data_dir/map_data.txt.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "particle_filter.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  //Set up parameters here (same as the simulator driver)
+  double delta_t = 0.1; // Time elapsed between measurements [sec]
+  double sensor_range = 50; // Sensor range [m]
+
+  double sigma_pos [3] = {0.3, 0.3, 0.01}; // GPS measurement uncertainty [x [m], y [m], theta [rad]]
+  double sigma_landmark [2] = {0.3, 0.3}; // Landmark measurement uncertainty [x [m], y [m]]
+
+  string data_dir = "../data";
+  string map_file;
+  int num_particles = 0;
+  int num_threads = 1;
+  unsigned long long seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--map") && i + 1 < argc) {
+      map_file = argv[++i];
+    } else if (!strcmp(argv[i], "--particles") && i + 1 < argc) {
+      num_particles = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoull(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-') {
+      data_dir = argv[i];
+    } else {
+      cerr << "Usage: " << argv[0] << " [data_dir] [--map file] [--particles n] [--threads n] [--seed s]" << endl;
+      return -1;
+    }
+  }
+  if (map_file.empty()) {
+    map_file = data_dir + "/map_data.txt";
+  }
+
+  // Read map data
+  Map map;
+  if (!read_map_data(map_file, map)) {
+    cout << "Error: Could not open map file " << map_file << endl;
+    return -1;
+  }
+
+  // Read position and ground truth data
+  vector<control_s> position_meas;
+  if (!read_control_data(data_dir + "/control_data.txt", position_meas)) {
+    cout << "Error: Could not open position/control measurement file" << endl;
+    return -1;
+  }
+  vector<ground_truth> gt;
+  if (!read_gt_data(data_dir + "/gt_data.txt", gt)) {
+    cout << "Error: Could not open ground truth data file" << endl;
+    return -1;
+  }
+
+  // Load every observation file up front so the timed loop measures the filter only
+  int num_time_steps = position_meas.size();
+  if ((int)gt.size() < num_time_steps) {
+    num_time_steps = gt.size();
+  }
+  vector<vector<LandmarkObs> > observations(num_time_steps);
+  for (int i = 0; i < num_time_steps; ++i) {
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "/observation/observations_%06d.txt", i + 1);
+    if (!read_landmark_data(data_dir + file_name, observations[i])) {
+      cout << "Error: Could not open observation file " << i + 1 << endl;
+      return -1;
+    }
+  }
+  if (num_time_steps == 0) {
+    cout << "Error: No time steps to replay" << endl;
+    return -1;
+  }
+
+  // Create particle filter
+  ParticleFilter pf(num_threads, seed);
+  if (num_particles > 0) {
+    pf.setNumParticles(num_particles);
+  }
+
+  double total_error[3] = {0, 0, 0};
+  double max_error[3] = {0, 0, 0};
+  double predict_time = 0, update_time = 0, resample_time = 0;
+  int num_resamples = 0;
+
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < num_time_steps; ++i) {
+
+    // Initialize from a noisy ground truth on the first step, predict afterwards
+    Clock::time_point t0 = Clock::now();
+    if (!pf.initialized()) {
+      Rng gps(seed);
+      double gps_noise[3];
+      gps.fillNormal(gps_noise, 3, 0.0, 1.0);
+      pf.init(gt[i].x + sigma_pos[0] * gps_noise[0], gt[i].y + sigma_pos[1] * gps_noise[1],
+              gt[i].theta + sigma_pos[2] * gps_noise[2], sigma_pos);
+    }
+    else {
+      pf.prediction(delta_t, sigma_pos, position_meas[i - 1].velocity, position_meas[i - 1].yawrate);
+    }
+    Clock::time_point t1 = Clock::now();
+
+    // Update the weights and resample
+    pf.updateWeights(sensor_range, sigma_landmark, observations[i], map);
+    Clock::time_point t2 = Clock::now();
+    pf.resample();
+    Clock::time_point t3 = Clock::now();
+
+    predict_time += chrono::duration<double>(t1 - t0).count();
+    update_time += chrono::duration<double>(t2 - t1).count();
+    resample_time += chrono::duration<double>(t3 - t2).count();
+    num_resamples += pf.resampled();
+
+    // Error of the highest weighted particle against ground truth
+    const ParticleStore& particles = pf.particleStore();
+    int best_index = pf.weightStats().best_index;
+    double *error = getError(gt[i].x, gt[i].y, gt[i].theta,
+                             particles.x[best_index], particles.y[best_index], particles.theta[best_index]);
+    for (int k = 0; k < 3; k++) {
+      total_error[k] += error[k];
+      max_error[k] = max(max_error[k], error[k]);
+    }
+  }
+  double total_time = seconds_since(start);
+
+  cout << fixed << setprecision(4);
+  cout << "Steps:            " << num_time_steps << " (" << num_resamples << " resampled)" << endl;
+  cout << "Particles:        " << pf.numParticles() << " at the end, " << pf.numThreads() << " thread(s)" << endl;
+  cout << "Mean error x/y/yaw: " << total_error[0] / num_time_steps << " " << total_error[1] / num_time_steps
+       << " " << total_error[2] / num_time_steps << endl;
+  cout << "Max error x/y/yaw:  " << max_error[0] << " " << max_error[1] << " " << max_error[2] << endl;
+  cout << "Per step [ms]:    predict " << 1e3 * predict_time / num_time_steps
+       << "  update " << 1e3 * update_time / num_time_steps
+       << "  resample " << 1e3 * resample_time / num_time_steps << endl;
+  cout << "Runtime:          " << total_time << " s, " << num_time_steps / total_time << " steps/s" << endl;
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * resampler.cpp
+ *
+ * O(N) resampling schemes for the particle filter.
+ */
+
+#include <math.h>
+
+#include "resampler.h"
+
+// Walks the weight CDF once with n sorted pointers; pointer k is (k + offsets[k * stride]) / n
+// in units of the total weight.
+static void walkCdf(const double* weights, int n, int count, const double* offsets, int stride,
+                    double total, int* indices) {
+    double step = total / count;
+    double cdf = weights[0];
+    int i = 0;
+    for (int k = 0; k < count; k++) {
+        double pointer = (k + offsets[k * stride]) * step;
+        while (pointer >= cdf && i < n - 1) {
+            cdf += weights[++i];
+        }
+        indices[k] = i;
+    }
+}
+
+static double sum(const double* weights, int n) {
+    double total = 0.0;
+    for (int i = 0; i < n; i++) {
+        total += weights[i];
+    }
+    return total;
+}
+
+void SystematicResampler::resample(const double* weights, int n, const double* uniforms, int* indices) {
+    walkCdf(weights, n, n, uniforms, 0, sum(weights, n), indices);
+}
+
+void StratifiedResampler::resample(const double* weights, int n, const double* uniforms, int* indices) {
+    walkCdf(weights, n, n, uniforms, 1, sum(weights, n), indices);
+}
+
+void ResidualResampler::resample(const double* weights, int n, const double* uniforms, int* indices) {
+
+    double scale = n / sum(weights, n);
+    residuals.resize(n);
+
+    // deterministic copies
+    int copied = 0;
+    double residual_total = 0.0;
+    for (int i = 0; i < n; i++) {
+        double expected = weights[i] * scale;
+        int copies = (int)floor(expected);
+        for (int c = 0; c < copies && copied < n; c++) {
+            indices[copied++] = i;
+        }
+        residuals[i] = expected - copies;
+        residual_total += residuals[i];
+    }
+
+    // remaining particles from the residual weights
+    int remaining = n - copied;
+    if (remaining == 0) {
+        return;
+    }
+    if (residual_total > 0.0) {
+        walkCdf(residuals.data(), n, remaining, uniforms, 0, residual_total, indices + copied);
+    } else {
+        // only reachable through rounding; repeat the deterministic copies
+        for (int k = copied; k < n; k++) {
+            indices[k] = indices[k % copied];
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * resampler.h
+ *
+ * O(N) resampling schemes for the particle filter.
+ */
+
+#ifndef RESAMPLER_H_
+#define RESAMPLER_H_
+
+#include <vector>
+
+/*
+ * Interface of a resampling scheme. Implementations draw ancestor indices in
+ * proportion to the particle weights from uniforms supplied by the caller, so
+ * they stay independent of the filter's random engine and never allocate once
+ * warmed up.
+ */
+class Resampler {
+public:
+
+	virtual ~Resampler() {}
+
+	/**
+	 * uniformsNeeded Number of uniform [0, 1) samples resample() consumes for n particles.
+	 */
+	virtual int uniformsNeeded(int n) const = 0;
+
+	/**
+	 * resample Draws n ancestor indices.
+	 * @param weights Particle weights, not necessarily normalized; their sum must be positive
+	 * @param n Number of particles
+	 * @param uniforms uniformsNeeded(n) samples from U[0, 1)
+	 * @param indices Output, n ancestor indices
+	 */
+	virtual void resample(const double* weights, int n, const double* uniforms, int* indices) = 0;
+};
+
+/*
+ * Systematic resampling: one uniform offset, n evenly spaced pointers.
+ */
+class SystematicResampler : public Resampler {
+public:
+	int uniformsNeeded(int n) const { return 1; }
+	void resample(const double* weights, int n, const double* uniforms, int* indices);
+};
+
+/*
+ * Stratified resampling: one independent uniform inside each of the n strata.
+ */
+class StratifiedResampler : public Resampler {
+public:
+	int uniformsNeeded(int n) const { return n; }
+	void resample(const double* weights, int n, const double* uniforms, int* indices);
+};
+
+/*
+ * Residual resampling: floor(n * w_i) deterministic copies of each particle,
+ * the remainder drawn systematically from the residual weights.
+ */
+class ResidualResampler : public Resampler {
+
+	// Residual weights, kept between calls to avoid reallocating
+	std::vector<double> residuals;
+
+public:
+	int uniformsNeeded(int n) const { return 1; }
+	void resample(const double* weights, int n, const double* uniforms, int* indices);
+};
+
+#endif /* RESAMPLER_H_ */
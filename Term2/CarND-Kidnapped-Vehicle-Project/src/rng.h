@@ -0,0 +1,131 @@
+/*
+ * rng.h
+ *
+ * Seedable xoshiro256** generator with bulk uniform and normal samplers.
+ */
+
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <stdint.h>
+
+#include "fast_math.h"
+
+/*
+ * xoshiro256** (Blackman & Vigna, 2018). Four 64-bit words of state, a few
+ * shifts and rotates per draw, and a jump() that advances the stream by 2^128
+ * draws so parallel workers get non-overlapping streams from a single seed.
+ */
+class Rng {
+
+	uint64_t s[4];
+
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+public:
+
+	explicit Rng(uint64_t seed_value = 0) {
+		seed(seed_value);
+	}
+
+	/**
+	 * seed Resets the state from a 64-bit seed, expanded with splitmix64.
+	 */
+	void seed(uint64_t seed_value) {
+		uint64_t z = seed_value;
+		for (int i = 0; i < 4; i++) {
+			z += 0x9E3779B97F4A7C15ULL;
+			uint64_t t = z;
+			t = (t ^ (t >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			t = (t ^ (t >> 27)) * 0x94D049BB133111EBULL;
+			s[i] = t ^ (t >> 31);
+		}
+	}
+
+	/**
+	 * next Returns the next 64 random bits.
+	 */
+	uint64_t next() {
+		const uint64_t result = rotl(s[1] * 5, 7) * 9;
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	/**
+	 * jump Advances the stream by 2^128 draws.
+	 */
+	void jump() {
+		static const uint64_t JUMP[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+		                                 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+		uint64_t t[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 4; i++) {
+			for (int b = 0; b < 64; b++) {
+				if (JUMP[i] & (1ULL << b)) {
+					for (int k = 0; k < 4; k++) {
+						t[k] ^= s[k];
+					}
+				}
+				next();
+			}
+		}
+		for (int k = 0; k < 4; k++) {
+			s[k] = t[k];
+		}
+	}
+
+	/**
+	 * uniform Returns a sample from U[0, 1) with 53 random bits.
+	 */
+	double uniform() {
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	/**
+	 * fillUniform Writes n samples from U[0, 1).
+	 */
+	void fillUniform(double* out, int n) {
+		for (int i = 0; i < n; i++) {
+			out[i] = uniform();
+		}
+	}
+
+	/**
+	 * fillNormal Writes n samples from N(mean, stddev^2) with the Box-Muller
+	 *   transform. The buffer is first filled with uniforms, then transformed in a
+	 *   branch-free pass (polynomial log and sincos) that the compiler vectorizes.
+	 */
+	void fillNormal(double* out, int n, double mean, double stddev) {
+
+		fillUniform(out, n);
+
+		// pair the first half with the second half so both loads stay contiguous
+		const double two_pi = 6.28318530717958647692;
+		const int half = n / 2;
+		double* __restrict u1 = out;
+		double* __restrict u2 = out + half;
+		for (int i = 0; i < half; i++) {
+			// 1 - u lies in (0, 1], so the log is finite
+			double r = stddev * sqrt(-2.0 * log_poly(1.0 - u1[i]));
+			double sin_t, cos_t;
+			sincos_poly(two_pi * u2[i], sin_t, cos_t);
+			u1[i] = mean + r * cos_t;
+			u2[i] = mean + r * sin_t;
+		}
+
+		// odd count: one more pair, keep one of them
+		if (n % 2 == 1) {
+			double r = stddev * sqrt(-2.0 * log_poly(1.0 - uniform()));
+			out[n - 1] = mean + r * cos(two_pi * uniform());
+		}
+	}
+};
+
+#endif /* RNG_H_ */
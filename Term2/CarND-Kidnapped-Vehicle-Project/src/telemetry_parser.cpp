@@ -0,0 +1,315 @@
+/*
+ * telemetry_parser.cpp
+ *
+ * Allocation-free reading of simulator telemetry messages and writing of the
+ * best particle reply.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_parser.h"
+
+using namespace std;
+
+static inline void skip_space(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+}
+
+static inline bool expect(const char*& p, const char* end, char c) {
+    skip_space(p, end);
+    if (p < end && *p == c) {
+        p++;
+        return true;
+    }
+    return false;
+}
+
+// Reads a JSON string; [begin, stop) is its content without the quotes (escapes are kept as is)
+static bool read_string(const char*& p, const char* end, const char*& begin, const char*& stop) {
+    if (!expect(p, end, '"')) {
+        return false;
+    }
+    begin = p;
+    while (p < end && *p != '"') {
+        p += (*p == '\\') ? 2 : 1;
+    }
+    if (p >= end) {
+        return false;
+    }
+    stop = p++;
+    return true;
+}
+
+// Reads one number. Plain decimals with at most 15 digits are exact as integer / 10^k (both
+// operands are exact doubles, so the division rounds correctly); anything else goes to strtod,
+// which needs a terminated string, so the token is copied to the stack first.
+static bool read_number(const char*& p, const char* end, double& value) {
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+                                    1e13, 1e14, 1e15 };
+    skip_space(p, end);
+    const char* begin = p;
+
+    const char* q = p;
+    bool negative = q < end && *q == '-';
+    q += negative;
+    long long mantissa = 0;
+    int digits = 0;
+    int fraction = -1;
+    for (; q < end; q++) {
+        if (*q >= '0' && *q <= '9') {
+            // past 15 digits the number takes the slow path, so stop before the mantissa overflows
+            if (digits < 15) {
+                mantissa = mantissa * 10 + (*q - '0');
+            }
+            digits++;
+            fraction += fraction >= 0;
+        } else if (*q == '.' && fraction < 0) {
+            fraction = 0;
+        } else {
+            break;
+        }
+    }
+    bool fast = digits > 0 && digits <= 15 && fraction != 0
+             && (q == end || (*q != 'e' && *q != 'E' && *q != '-' && *q != '+'));
+    if (fast) {
+        value = (negative ? -mantissa : mantissa) / pow10[fraction > 0 ? fraction : 0];
+        p = q;
+        return true;
+    }
+
+    while (p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) {
+        p++;
+    }
+    char token[64];
+    size_t length = p - begin;
+    if (length == 0 || length >= sizeof(token)) {
+        return false;
+    }
+    memcpy(token, begin, length);
+    token[length] = '\0';
+    char* parsed;
+    value = strtod(token, &parsed);
+    return parsed == token + length;
+}
+
+// Reads a value given as a number or as a string holding one number
+static bool read_scalar(const char*& p, const char* end, double& value) {
+    skip_space(p, end);
+    if (p < end && *p == '"') {
+        const char *begin, *stop;
+        if (!read_string(p, end, begin, stop) || !read_number(begin, stop, value)) {
+            return false;
+        }
+        skip_space(begin, stop);
+        return begin == stop;
+    }
+    return read_number(p, end, value);
+}
+
+// Reads a non-negative integer; a fraction, an exponent or a value beyond long long fails
+static bool read_integer(const char*& p, const char* end, long long& value) {
+    skip_space(p, end);
+    const char* q = p;
+    long long result = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++) {
+        int digit = *q - '0';
+        if (result > (LLONG_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    if (q == p || (q < end && (*q == '.' || *q == 'e' || *q == 'E'))) {
+        return false;
+    }
+    value = result;
+    p = q;
+    return true;
+}
+
+// Reads an id given as an integer or as a string holding one
+static bool read_id(const char*& p, const char* end, long long& value) {
+    skip_space(p, end);
+    if (p < end && *p == '"') {
+        const char *begin, *stop;
+        if (!read_string(p, end, begin, stop) || !read_integer(begin, stop, value)) {
+            return false;
+        }
+        skip_space(begin, stop);
+        return begin == stop;
+    }
+    return read_integer(p, end, value);
+}
+
+// Steps over a value of a field that is not needed
+static bool skip_value(const char*& p, const char* end) {
+    skip_space(p, end);
+    int depth = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            const char *begin, *stop;
+            if (!read_string(p, end, begin, stop)) {
+                return false;
+            }
+            if (depth == 0) {
+                return true;
+            }
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return true;
+            }
+            depth--;
+        } else if (c == ',' && depth == 0) {
+            return true;
+        }
+        p++;
+    }
+    return false;
+}
+
+static inline bool is_key(const char* begin, const char* stop, const char* key) {
+    size_t length = strlen(key);
+    return (size_t)(stop - begin) == length && memcmp(begin, key, length) == 0;
+}
+
+TelemetryResult parse_telemetry(const char* data, size_t length, Telemetry& out) {
+
+    // "42" at the start of the message means there's a websocket message event
+    if (length < 2 || data[0] != '4' || data[1] != '2') {
+        return TELEMETRY_IGNORED;
+    }
+    const char* p = data + 2;
+    const char* end = data + length;
+
+    const char *event, *event_end;
+    if (!expect(p, end, '[') || !read_string(p, end, event, event_end) || !is_key(event, event_end, "telemetry")
+        || !expect(p, end, ',')) {
+        return TELEMETRY_IGNORED;
+    }
+    if (!expect(p, end, '{')) {
+        // "null" instead of the data object
+        return TELEMETRY_MANUAL;
+    }
+
+    enum {
+        SENSE_X = 1, SENSE_Y = 2, SENSE_THETA = 4, VELOCITY = 8, YAWRATE = 16, OBS_X = 32, OBS_Y = 64,
+        ALL_FIELDS = 127
+    };
+    int found = 0;
+    out.vehicle_id = -1;
+    const char *obs_x = NULL, *obs_x_end = NULL, *obs_y = NULL, *obs_y_end = NULL;
+
+    skip_space(p, end);
+    if (p < end && *p == '}') {
+        return TELEMETRY_MANUAL;
+    }
+    do {
+        const char *key, *key_end;
+        if (!read_string(p, end, key, key_end) || !expect(p, end, ':')) {
+            return TELEMETRY_IGNORED;
+        }
+        bool ok = true;
+        if (is_key(key, key_end, "sense_x")) {
+            ok = read_scalar(p, end, out.sense_x);
+            found |= SENSE_X;
+        } else if (is_key(key, key_end, "sense_y")) {
+            ok = read_scalar(p, end, out.sense_y);
+            found |= SENSE_Y;
+        } else if (is_key(key, key_end, "sense_theta")) {
+            ok = read_scalar(p, end, out.sense_theta);
+            found |= SENSE_THETA;
+        } else if (is_key(key, key_end, "previous_velocity")) {
+            ok = read_scalar(p, end, out.previous_velocity);
+            found |= VELOCITY;
+        } else if (is_key(key, key_end, "previous_yawrate")) {
+            ok = read_scalar(p, end, out.previous_yawrate);
+            found |= YAWRATE;
+        } else if (is_key(key, key_end, "sense_observations_x")) {
+            ok = read_string(p, end, obs_x, obs_x_end);
+            found |= OBS_X;
+        } else if (is_key(key, key_end, "sense_observations_y")) {
+            ok = read_string(p, end, obs_y, obs_y_end);
+            found |= OBS_Y;
+        } else if (is_key(key, key_end, "vehicle_id")) {
+            ok = read_id(p, end, out.vehicle_id);
+        } else {
+            ok = skip_value(p, end);
+        }
+        if (!ok) {
+            return TELEMETRY_IGNORED;
+        }
+    } while (expect(p, end, ','));
+
+    if (!expect(p, end, '}') || found != ALL_FIELDS) {
+        return TELEMETRY_IGNORED;
+    }
+
+    // space separated lists; pair x and y up to the shorter list
+    out.observations.clear();
+    double value;
+    skip_space(obs_x, obs_x_end);
+    while (obs_x < obs_x_end && read_number(obs_x, obs_x_end, value)) {
+        LandmarkObs obs;
+        obs.id = -1;
+        obs.x = value;
+        obs.y = 0.0;
+        out.observations.push_back(obs);
+        skip_space(obs_x, obs_x_end);
+    }
+    size_t count = 0;
+    skip_space(obs_y, obs_y_end);
+    while (count < out.observations.size() && obs_y < obs_y_end && read_number(obs_y, obs_y_end, value)) {
+        out.observations[count++].y = value;
+        skip_space(obs_y, obs_y_end);
+    }
+    out.observations.resize(count);
+    return TELEMETRY_OK;
+}
+
+static inline void append_number(string& out, const char* format, double value) {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), format, value);
+    out.append(buffer, length);
+}
+
+void write_best_particle(const ParticleStore& store, int best, string& out, long long vehicle_id) {
+
+    out.assign("42[\"best_particle\",{");
+    if (vehicle_id >= 0) {
+        char buffer[32];
+        out.append(buffer, snprintf(buffer, sizeof(buffer), "\"vehicle_id\":%lld,", vehicle_id));
+    }
+    out.append("\"best_particle_x\":");
+    append_number(out, "%.17g", store.x[best]);
+    out.append(",\"best_particle_y\":");
+    append_number(out, "%.17g", store.y[best]);
+    out.append(",\"best_particle_theta\":");
+    append_number(out, "%.17g", store.theta[best]);
+
+    //Optional message data used for debugging particle's sensing and associations
+    int slot = best * store.assoc_stride;
+    int count = store.keep_associations ? store.assoc_count[best] : 0;
+    out.append(",\"best_particle_associations\":\"");
+    for (int k = 0; k < count; k++) {
+        char buffer[16];
+        out.append(buffer, snprintf(buffer, sizeof(buffer), k ? " %d" : "%d", store.associations[slot + k]));
+    }
+    out.append("\",\"best_particle_sense_x\":\"");
+    for (int k = 0; k < count; k++) {
+        append_number(out, k ? " %g" : "%g", (float)store.sense_x[slot + k]);
+    }
+    out.append("\",\"best_particle_sense_y\":\"");
+    for (int k = 0; k < count; k++) {
+        append_number(out, k ? " %g" : "%g", (float)store.sense_y[slot + k]);
+    }
+    out.append("\"}]");
+}
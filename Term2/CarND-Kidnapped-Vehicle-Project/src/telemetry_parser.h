@@ -0,0 +1,62 @@
+/*
+ * telemetry_parser.h
+ *
+ * Allocation-free reading of simulator telemetry messages and writing of the
+ * best particle reply.
+ */
+
+#ifndef TELEMETRY_PARSER_H_
+#define TELEMETRY_PARSER_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "helper_functions.h"
+#include "particle_store.h"
+
+/*
+ * Fields of one telemetry event. Reused across messages: observations keeps its
+ * capacity, so steady-state parsing does not allocate.
+ */
+struct Telemetry {
+
+	double sense_x;            // Noisy GPS position [m]
+	double sense_y;
+	double sense_theta;        // Noisy GPS yaw [rad]
+	double previous_velocity;  // Control from the previous step [m/s]
+	double previous_yawrate;   // [rad/s]
+
+	// Landmark observations in vehicle coordinates
+	std::vector<LandmarkObs> observations;
+
+	// Optional "vehicle_id" field, to run several vehicles over one connection; -1 if absent.
+	// It must be a non-negative integer, or the message is ignored
+	long long vehicle_id;
+};
+
+enum TelemetryResult {
+	TELEMETRY_IGNORED,  // Not a telemetry event, or malformed
+	TELEMETRY_MANUAL,   // Telemetry event without data (simulator in manual mode)
+	TELEMETRY_OK        // All fields were read into the Telemetry
+};
+
+/**
+ * parse_telemetry Reads a socket.io message of the form
+ *   42["telemetry",{"sense_x":"..",...,"sense_observations_x":"x1 x2 ..",...}]
+ *   in a single pass over the buffer. The buffer need not be null-terminated and
+ *   is never read past length. Values may be JSON strings or numbers.
+ * @param (data,length) Message buffer as received from the websocket
+ * @param out Receives the fields; only valid if TELEMETRY_OK is returned
+ */
+TelemetryResult parse_telemetry(const char* data, size_t length, Telemetry& out);
+
+/**
+ * write_best_particle Formats the "best_particle" reply for particle best of the
+ *   store, with its debug associations if the store keeps them.
+ * @param out Receives the message; cleared first, its capacity is reused
+ * @param vehicle_id Echoed as "vehicle_id" unless negative
+ */
+void write_best_particle(const ParticleStore& store, int best, std::string& out, long long vehicle_id = -1);
+
+#endif /* TELEMETRY_PARSER_H_ */
@@ -0,0 +1,85 @@
+/*
+ * thread_pool.cpp
+ *
+ * Persistent fork-join worker pool used to split particle ranges across cores.
+ */
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int num_workers)
+    : task(nullptr), trampoline(nullptr), num_items(0), generation(0), pending(0), stop(false) {
+
+    for (int w = 1; w < num_workers; w++) {
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, w));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    start_cv.notify_all();
+    for (unsigned t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
+
+void ThreadPool::range(int n, int worker, int& begin, int& end) const {
+    int workers = size();
+    int chunk = (n + workers - 1) / workers;
+    begin = std::min(n, worker * chunk);
+    end = std::min(n, begin + chunk);
+}
+
+void ThreadPool::runChunk(int worker) {
+    int begin, end;
+    range(num_items, worker, begin, end);
+    if (begin < end) {
+        trampoline(task, begin, end, worker);
+    }
+}
+
+void ThreadPool::run(int n, const void* job, Trampoline job_trampoline) {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = job;
+        trampoline = job_trampoline;
+        num_items = n;
+        pending = (int)threads.size();
+        generation++;
+    }
+    start_cv.notify_all();
+
+    runChunk(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return pending == 0; });
+    task = nullptr;
+    trampoline = nullptr;
+}
+
+void ThreadPool::workerLoop(int worker) {
+
+    unsigned long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [this, seen] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+        }
+
+        runChunk(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) {
+            done_cv.notify_one();
+        }
+    }
+}
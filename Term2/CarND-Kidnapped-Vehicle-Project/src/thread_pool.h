@@ -0,0 +1,100 @@
+/*
+ * thread_pool.h
+ *
+ * Persistent fork-join worker pool used to split particle ranges across cores.
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+
+	// Worker threads; the calling thread acts as worker 0
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+
+	// Runs a job's callable on one slice; the callable is passed by pointer, so posting
+	// a job never copies or allocates
+	typedef void (*Trampoline)(const void* task, int begin, int end, int worker);
+
+	template <typename Task>
+	static void invoke(const void* task, int begin, int end, int worker) {
+		(*static_cast<const Task*>(task))(begin, end, worker);
+	}
+
+	// Current job, valid while pending > 0
+	const void* task;
+	Trampoline trampoline;
+	int num_items;
+
+	// Bumped for every job so sleeping workers can tell a new one was posted
+	unsigned long generation;
+
+	// Number of workers that have not finished the current job
+	int pending;
+
+	bool stop;
+
+	void workerLoop(int worker);
+
+	void runChunk(int worker);
+
+	// Posts a job to the workers, runs slice 0 and waits for the rest
+	void run(int n, const void* task, Trampoline trampoline);
+
+public:
+
+	/**
+	 * Constructor
+	 * @param num_workers Number of workers including the calling thread (at least 1)
+	 */
+	explicit ThreadPool(int num_workers);
+
+	// Destructor, joins all workers
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * size Returns the number of workers, including the calling thread.
+	 */
+	int size() const {
+		return (int)threads.size() + 1;
+	}
+
+	/**
+	 * range Returns the slice [begin, end) of n items statically assigned to a worker.
+	 *   The split only depends on n and the worker count, so results are reproducible.
+	 */
+	void range(int n, int worker, int& begin, int& end) const;
+
+	/**
+	 * parallelFor Runs task(begin, end, worker) on every worker's slice of [0, n)
+	 *   and returns once all of them are done. Takes any callable, such as a lambda,
+	 *   by reference instead of wrapping it in a std::function, which would allocate
+	 *   for captures larger than two pointers.
+	 */
+	template <typename Task>
+	void parallelFor(int n, const Task& task) {
+
+		// single worker: run inline without touching the synchronisation
+		if (threads.empty()) {
+			if (n > 0) {
+				task(0, n, 0);
+			}
+			return;
+		}
+		run(n, &task, &invoke<Task>);
+	}
+};
+
+#endif /* THREAD_POOL_H_ */
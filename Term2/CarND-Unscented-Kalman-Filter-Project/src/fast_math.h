@@ -0,0 +1,107 @@
+/*
+ * fast_math.h
+ *
+ * Polynomial replacements for libm functions that the compiler can inline
+ * into vectorized loops.
+ */
+
+#ifndef FAST_MATH_H_
+#define FAST_MATH_H_
+
+#include <math.h>
+
+/*
+ * Rounds to the nearest integer with the 1.5 * 2^52 trick. Unlike floor/nearbyint
+ * this vectorizes without -fno-trapping-math. Valid for |v| < 2^51.
+ */
+inline double round_nearest(double v) {
+	const double magic = 6755399441055744.0;
+	return (v + magic) - magic;
+}
+
+/*
+ * Computes sin(t) and cos(t) together with a Cody-Waite reduction to
+ * [-pi/4, pi/4] and Cephes minimax polynomials (accurate to ~1 ulp for the
+ * headings a tracker sees). Only arithmetic and selects, so it
+ * inlines into vectorized loops.
+ */
+inline void sincos_poly(double t, double& s, double& c) {
+
+	const double two_over_pi = 0.63661977236758134308;
+	const double pio2_1 = 1.57079625129699707031;
+	const double pio2_2 = 7.54978941586159635335e-08;
+	const double pio2_3 = 5.39030285815811905290e-15;
+
+	// quadrant and reduced argument
+	double q = round_nearest(t * two_over_pi);
+	double r = ((t - q * pio2_1) - q * pio2_2) - q * pio2_3;
+	double z = r * r;
+
+	double sr = 1.58962301576546568060e-10;
+	sr = sr * z - 2.50507477628578072866e-8;
+	sr = sr * z + 2.75573136213857245213e-6;
+	sr = sr * z - 1.98412698295895385996e-4;
+	sr = sr * z + 8.33333333332211858878e-3;
+	sr = sr * z - 1.66666666666666307295e-1;
+	sr = r + r * z * sr;
+
+	double cr = -1.13585365213876817300e-11;
+	cr = cr * z + 2.08757008419747316778e-9;
+	cr = cr * z - 2.75573141792967388112e-7;
+	cr = cr * z + 2.48015872888517045348e-5;
+	cr = cr * z - 1.38888888888730564116e-3;
+	cr = cr * z + 4.16666666666665929218e-2;
+	cr = 1.0 - 0.5 * z + z * z * cr;
+
+	// map back to the original quadrant; q is integral, so rounding q/4 - 3/8 gives floor(q/4)
+	double m = q - 4.0 * round_nearest(q * 0.25 - 0.375);
+	bool odd = (m == 1.0) || (m == 3.0);
+	double s_q = odd ? cr : sr;
+	double c_q = odd ? sr : cr;
+	s = (m >= 2.0) ? -s_q : s_q;
+	c = (m == 1.0 || m == 2.0) ? -c_q : c_q;
+}
+
+/*
+ * Computes atan2(y, x) from the Cephes atan rational approximation on
+ * min(|x|, |y|) / max(|x|, |y|), reduced to [0, tan(pi/8)] and mapped back to
+ * the octant and quadrant with selects. Returns 0 for (0, 0). Absolute error
+ * is a few 1e-16.
+ */
+inline double atan2_poly(double y, double x) {
+
+	const double pio2 = 1.57079632679489661923;
+	const double pio4 = 0.78539816339744830962;
+	const double more_bits = 6.123233995736765886130e-17;
+
+	double ax = fabs(x);
+	double ay = fabs(y);
+	double hi = ax > ay ? ax : ay;
+	double lo = ax > ay ? ay : ax;
+	double t = hi > 0.0 ? lo / hi : 0.0;
+
+	// t in [0, 1]; above tan(pi/8) use atan(t) = pi/4 + atan((t - 1) / (t + 1))
+	bool upper = t > 0.41421356237309504880;
+	double r = upper ? (t - 1.0) / (t + 1.0) : t;
+	double z = r * r;
+
+	double p = -8.750608600031904122785e-1;
+	p = p * z - 1.615753718733365076637e1;
+	p = p * z - 7.500855792314704667340e1;
+	p = p * z - 1.228866684490136173410e2;
+	p = p * z - 6.485021904942025371773e1;
+	double q = z + 2.485846490142306297962e1;
+	q = q * z + 1.650270098316988542046e2;
+	q = q * z + 4.328810604912902668951e2;
+	q = q * z + 4.853903996359136964868e2;
+	q = q * z + 1.945506571482613964425e2;
+	double a = r + r * z * p / q;
+	a = upper ? a + (pio4 + 0.5 * more_bits) : a;
+
+	// back to the first quadrant, then to the quadrant of (x, y)
+	a = ay > ax ? (pio2 - a) + more_bits : a;
+	a = x < 0.0 ? (2.0 * pio2 - a) + 2.0 * more_bits : a;
+	return y < 0.0 ? -a : a;
+}
+
+#endif /* FAST_MATH_H_ */
@@ -0,0 +1,213 @@
+#include "imm.h"
+#include "trace.h"
+#include <math.h>
+
+using namespace std;
+
+IMM::IMM(int num_threads) : pool_(num_threads) {
+  is_initialized_ = false;
+  time_us_ = 0;
+  x_.setZero();
+  P_.setIdentity();
+
+  // as UKF
+  P_init_ << .2, 0, 0, 0, 0,
+             0, .2, 0, 0, 0,
+             0, 0, 2, 0, 0,
+             0, 0, 0, .1, 0,
+             0, 0, 0, 0, .1;
+
+  std_laspx_ = 0.15;
+  std_laspy_ = 0.15;
+  std_radr_ = 0.3;
+  std_radphi_ = 0.03;
+  std_radrd_ = 0.3;
+
+  stay_probability_ = 0.98;
+
+  measurement_ = NULL;
+  delta_t_ = 0;
+
+  // straight driving with little acceleration, and turns with the noise of UKF
+  AddMode(MotionModel::CV, 0.5, 0.05);
+  AddMode(MotionModel::CTRV, 2, 1);
+}
+
+void IMM::ClearModes() {
+  modes_.clear();
+  transition_.resize(0, 0);
+  mixing_.resize(0, 0);
+  probability_.resize(0);
+  predicted_probability_.resize(0);
+  is_initialized_ = false;
+}
+
+int IMM::AddMode(MotionModel::Type type, double std_a, double std_yawdd) {
+  ModeState mode;
+  mode.model = MotionModel(type);
+  mode.noise_std << std_a, std_yawdd;
+  modes_.push_back(mode);
+
+  int n = NumModes();
+  probability_.setConstant(n, 1.0 / n);
+  predicted_probability_.setConstant(n, 1.0 / n);
+  if (n == 1) {
+    transition_.setOnes(1, 1);
+  } else {
+    transition_.setConstant(n, n, (1 - stay_probability_) / (n - 1));
+    transition_.diagonal().setConstant(stay_probability_);
+  }
+  mixing_.setZero(n, n);
+  is_initialized_ = false;
+  return n - 1;
+}
+
+void IMM::ProcessMeasurement(const MeasurementPackage& meas_package) {
+  TRACE_SCOPE("imm.process");
+
+  if (NumModes() == 0) {
+    TRACE_LOG("Dropped measurement at " << meas_package.timestamp_ << ", no modes");
+    return;
+  }
+  if (!is_initialized_) {
+    Initialize(meas_package);
+    return;
+  }
+  if (meas_package.timestamp_ < time_us_) {
+    TRACE_LOG("Dropped measurement at " << meas_package.timestamp_ << ", older than time_us_");
+    return;
+  }
+
+  delta_t_ = (meas_package.timestamp_ - time_us_)*1e-6; // us to seconds
+  time_us_ = meas_package.timestamp_;
+  measurement_ = &meas_package;
+
+  Mix();
+  {
+    TRACE_SCOPE("imm.modes");
+    pool_.parallelFor(NumModes(), [this](int begin, int end, int) {
+      for (int m = begin; m < end; m++) {
+        StepMode(m);
+      }
+    });
+  }
+  UpdateProbabilities();
+
+  //combined estimate, yaw relative to the most likely mode
+  int best;
+  probability_.maxCoeff(&best);
+  Moments(probability_.data(), best, x_, P_);
+
+  TRACE_STATE("imm.x", time_us_, x_);
+  TRACE_STATE("imm.P", time_us_, P_);
+}
+
+void IMM::Initialize(const MeasurementPackage& meas_package) {
+  if (meas_package.sensor_type_ == MeasurementPackage::RADAR) {
+    double rho = meas_package.raw_measurements_(0);
+    double phi = meas_package.raw_measurements_(1);
+    x_ << rho*cos(phi), rho*sin(phi), meas_package.raw_measurements_(2), phi, 0;
+  } else {
+    x_ << meas_package.raw_measurements_(0), meas_package.raw_measurements_(1), 0, 0, 0;
+  }
+  P_ = P_init_;
+  for (int m = 0; m < NumModes(); m++) {
+    modes_[m].filter.x_ = x_;
+    modes_[m].filter.P_ = P_;
+  }
+  probability_.setConstant(1.0 / NumModes());
+  time_us_ = meas_package.timestamp_;
+  is_initialized_ = true;
+  TRACE_LOG("is_initialized_ using " << meas_package.sensor_type_);
+}
+
+void IMM::Mix() {
+  TRACE_SCOPE("imm.mix");
+  int n = NumModes();
+  for (int j = 0; j < n; j++) {
+    double c = 0;
+    for (int i = 0; i < n; i++) {
+      c += transition_(i, j) * probability_(i);
+    }
+    predicted_probability_(j) = c;
+    for (int i = 0; i < n; i++) {
+      mixing_(i, j) = c > 0 ? transition_(i, j) * probability_(i) / c : (i == j);
+    }
+  }
+  for (int j = 0; j < n; j++) {
+    Moments(mixing_.col(j).data(), j, modes_[j].x_mixed, modes_[j].P_mixed);
+  }
+}
+
+void IMM::StepMode(int m) {
+  ModeState& mode = modes_[m];
+  ModeFilter& filter = mode.filter;
+  filter.x_ = mode.x_mixed;
+  filter.P_ = mode.P_mixed;
+
+  filter.Predict(delta_t_, mode.noise_std, mode.model);
+
+  const MeasurementPackage& meas_package = *measurement_;
+  if (meas_package.sensor_type_ == MeasurementPackage::LASER) {
+    LidarModel::MeasVector z = meas_package.raw_measurements_.head<LidarModel::NZ>();
+    LidarModel::MeasMatrix R;
+    R << std_laspx_*std_laspx_, 0,
+         0, std_laspy_*std_laspy_;
+    filter.Update(z, R, LidarModel());
+  } else {
+    RadarModel::MeasVector z = meas_package.raw_measurements_.head<RadarModel::NZ>();
+    RadarModel::MeasMatrix R;
+    R << std_radr_*std_radr_, 0, 0,
+         0, std_radphi_*std_radphi_, 0,
+         0, 0, std_radrd_*std_radrd_;
+    filter.Update(z, R, RadarModel());
+  }
+  filter.x_(MotionModel::YAW) = NormalizeAngle(filter.x_(MotionModel::YAW));
+}
+
+void IMM::UpdateProbabilities() {
+  //mu_j proportional to c_j * exp(log_likelihood_j), scaled by the largest
+  //likelihood so that the exponentials do not underflow
+  int n = NumModes();
+  double max_log = -INFINITY;
+  for (int m = 0; m < n; m++) {
+    double l = modes_[m].filter.log_likelihood_;
+    if (isfinite(l) && l > max_log) {
+      max_log = l;
+    }
+  }
+
+  double sum = 0;
+  for (int m = 0; m < n; m++) {
+    double l = modes_[m].filter.log_likelihood_;
+    double mu = predicted_probability_(m);
+    if (isfinite(max_log)) {
+      mu = isfinite(l) ? mu * exp(l - max_log) : 0;
+    }
+    probability_(m) = mu;
+    sum += mu;
+  }
+  probability_ /= sum;
+}
+
+void IMM::Moments(const double* weights, int ref, StateVector& x, StateMatrix& P) const {
+  int n = NumModes();
+  const int yaw = MotionModel::YAW;
+  const StateVector& x_ref = modes_[ref].filter.x_;
+
+  StateVector dx = StateVector::Zero();
+  for (int i = 0; i < n; i++) {
+    StateVector d = modes_[i].filter.x_ - x_ref;
+    d(yaw) = NormalizeAngle(d(yaw));
+    dx += weights[i] * d;
+  }
+  x = x_ref + dx;
+  x(yaw) = NormalizeAngle(x(yaw));
+
+  P.setZero();
+  for (int i = 0; i < n; i++) {
+    StateVector d = modes_[i].filter.x_ - x;
+    d(yaw) = NormalizeAngle(d(yaw));
+    P += weights[i] * (modes_[i].filter.P_ + d * d.transpose());
+  }
+}
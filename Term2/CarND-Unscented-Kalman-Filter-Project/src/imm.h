@@ -0,0 +1,186 @@
+#ifndef IMM_H
+#define IMM_H
+
+#include "measurement_package.h"
+#include "ukf_core.h"
+#include "thread_pool.h"
+#include "Eigen/Dense"
+#include <vector>
+
+/**
+ * Process model of an IMM mode, chosen at run time among the models on the
+ * CTRV state [pos1 pos2 vel_abs yaw_angle yaw_rate]
+ */
+struct MotionModel {
+  enum Type { CV, CTRV };
+  enum { NX = CTRVModel::NX, NAUG = CTRVModel::NAUG, YAW = CTRVModel::YAW };
+
+  Type type;
+
+  explicit MotionModel(Type model_type = CTRV) : type(model_type) {}
+
+  void Propagate(const Eigen::Matrix<double, NAUG, 1>& x_aug, double delta_t,
+                 Eigen::Matrix<double, NX, 1>& x_pred) const {
+    if (type == CV) {
+      CVModel().Propagate(x_aug, delta_t, x_pred);
+    } else {
+      CTRVModel().Propagate(x_aug, delta_t, x_pred);
+    }
+  }
+};
+
+/**
+ * Interacting multiple model (IMM) estimator for one target.
+ *
+ * Every mode is an unscented Kalman filter with its own motion model and
+ * process noise, by default a constant velocity mode for straight driving and
+ * the CTRV model of UKF for turns. The mode switches as a Markov chain with the
+ * transition matrix transition_. For each measurement:
+ *   1. mixing: each mode starts from the mix of all mode estimates, weighted
+ *      by the probability that the target was in that mode given it is in
+ *      this one now
+ *   2. every mode predicts and updates its filter with its own model
+ *   3. the mode probabilities are updated with the likelihood of the
+ *      measurement in each mode
+ *   4. the output x_, P_ is the probability-weighted mix of the modes
+ * The modes share the CTRV state, so the mixing needs no conversion; yaw
+ * differences are wrapped before they are averaged.
+ *
+ * Step 2 is independent per mode and runs on a ThreadPool, one range of modes
+ * per worker. All buffers are allocated by AddMode, so processing a
+ * measurement does not allocate.
+ */
+class IMM {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  enum { NX = CTRVModel::NX, NAUG = CTRVModel::NAUG };
+
+  typedef UKFCore<NX, NAUG> ModeFilter;
+  typedef ModeFilter::StateVector StateVector;
+  typedef ModeFilter::StateMatrix StateMatrix;
+
+  ///* initially set to false, set to true in first call of ProcessMeasurement
+  bool is_initialized_;
+
+  ///* combined state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
+  StateVector x_;
+
+  ///* combined state covariance matrix
+  StateMatrix P_;
+
+  ///* time when the state is true, in us
+  long long time_us_;
+
+  ///* state covariance of every mode at initialization
+  StateMatrix P_init_;
+
+  ///* Laser measurement noise standard deviation position1/position2 in m
+  double std_laspx_;
+  double std_laspy_;
+
+  ///* Radar measurement noise standard deviation radius in m, angle in rad, radius change in m/s
+  double std_radr_;
+  double std_radphi_;
+  double std_radrd_;
+
+  ///* probability that the target stays in its mode between two measurements;
+  ///* AddMode spreads the rest evenly over the other modes
+  double stay_probability_;
+
+  ///* T(i, j) is the probability of switching from mode i to mode j between two measurements
+  Eigen::MatrixXd transition_;
+
+  /**
+   * Constructor, with a CV mode and a CTRV mode
+   * @param num_threads Number of threads running the modes, including the caller
+   */
+  explicit IMM(int num_threads = 1);
+
+  /**
+   * ClearModes Removes all modes, to configure another set with AddMode;
+   *   measurements are dropped until at least one mode is added
+   */
+  void ClearModes();
+
+  /**
+   * AddMode Adds a mode before the first measurement, with equal initial
+   *   probabilities and the default transition matrix
+   * @param type Motion model of the mode
+   * @param std_a Process noise standard deviation longitudinal acceleration in m/s^2
+   * @param std_yawdd Process noise standard deviation yaw acceleration in rad/s^2
+   * @return Index of the mode
+   */
+  int AddMode(MotionModel::Type type, double std_a, double std_yawdd);
+
+  /**
+   * ProcessMeasurement Runs one IMM cycle; a measurement older than time_us_,
+   *   or any measurement while there are no modes, is dropped
+   * @param meas_package The latest measurement data of either radar or laser
+   */
+  void ProcessMeasurement(const MeasurementPackage& meas_package);
+
+  int NumModes() const {
+    return (int)modes_.size();
+  }
+
+  double ModeProbability(int mode) const {
+    return probability_(mode);
+  }
+
+  /**
+   * Mode The filter of a mode, with the estimate of that mode alone
+   */
+  const ModeFilter& Mode(int mode) const {
+    return modes_[mode].filter;
+  }
+
+private:
+  struct ModeState {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    MotionModel model;
+    ModeFilter::NoiseVector noise_std;
+    ModeFilter filter;
+    StateVector x_mixed;  // initial condition of the cycle, after mixing
+    StateMatrix P_mixed;
+
+    ModeState() : filter(MotionModel::YAW) {
+      noise_std.setZero();
+      x_mixed.setZero();
+      P_mixed.setIdentity();
+    }
+  };
+
+  ThreadPool pool_;
+  std::vector<ModeState, Eigen::aligned_allocator<ModeState> > modes_;
+
+  ///* mode probabilities mu, and their prediction sum_i T(i, j) mu_i before the measurement
+  Eigen::VectorXd probability_;
+  Eigen::VectorXd predicted_probability_;
+
+  ///* mixing_(i, j) is the probability of mode i at the last measurement given mode j now
+  Eigen::MatrixXd mixing_;
+
+  ///* measurement and time step of the current cycle, read by the workers
+  const MeasurementPackage* measurement_;
+  double delta_t_;
+
+  void Initialize(const MeasurementPackage& meas_package);
+
+  // Mixed initial condition of every mode
+  void Mix();
+
+  // Predict and update of one mode
+  void StepMode(int mode);
+
+  void UpdateProbabilities();
+
+  /**
+   * Moments Mean and covariance of the mixture of the mode estimates with the
+   *   given weights; the yaw is averaged as differences to mode ref
+   */
+  void Moments(const double* weights, int ref, StateVector& x, StateMatrix& P) const;
+};
+
+#endif /* IMM_H */
@@ -2,8 +2,10 @@
 #include <iostream>
 #include "json.hpp"
 #include <math.h>
+#include <string.h>
 #include "ukf.h"
 #include "tools.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -26,13 +28,23 @@ std::string hasData(std::string s) {
   return "";
 }
 
-int main()
+int main(int argc, char* argv[])
 {
   uWS::Hub h;
 
   // Create a Kalman Filter instance
   UKF ukf;
 
+  // --sqrt: run the square-root filter
+  // --adapt: tune the process noise from the NIS
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--sqrt") == 0) {
+      ukf.square_root_ = true;
+    } else if (strcmp(argv[i], "--adapt") == 0) {
+      ukf.adapt_noise_ = true;
+    }
+  }
+
   // used to compute the RMSE later
   Tools tools;
   vector<VectorXd> estimations;
@@ -169,9 +181,25 @@ int main()
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+  h.onDisconnection([&h,&ukf](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
     ws.close();
     std::cout << "Disconnected" << std::endl;
+
+    // filter consistency: a share well above 5% means the filter is overconfident
+    const char* names[] = { "lidar", "radar" };
+    const int dimensions[] = { LidarModel::NZ, RadarModel::NZ };
+    for (int i = 0; i < 2; i++) {
+      const NISMonitor& nis = ukf.NIS(dimensions[i]);
+      std::cout << "NIS " << names[i] << ": " << nis.Count() << " updates, " << 100 * nis.FractionAbove()
+                << "% above " << nis.Threshold() << ", recent mean " << nis.WindowMean() << std::endl;
+    }
+
+    // stage timings and state history of traced builds (-DENABLE_TRACE=ON, TRACE_LEVEL > 0)
+    trace::Report(std::cout);
+    const char* trace_file = getenv("TRACE_FILE");
+    if (trace_file) {
+      trace::WriteRing(trace_file);
+    }
   });
 
   int port = 4567;
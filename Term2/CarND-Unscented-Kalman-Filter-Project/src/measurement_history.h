@@ -0,0 +1,139 @@
+#ifndef MEASUREMENT_HISTORY_H_
+#define MEASUREMENT_HISTORY_H_
+
+#include "measurement_package.h"
+#include "Eigen/Dense"
+#include <vector>
+
+/**
+ * Bounded history of the latest measurements of a filter, in timestamp order,
+ * with the filter state saved after them.
+ *
+ * A measurement that arrives late is inserted at its timestamp. The filter then
+ * resumes from the latest saved state before it and re-applies the measurements
+ * from there on, so the result is the same as if the measurements had arrived
+ * in order. State is whatever the filter needs to resume, e.g. its mean,
+ * covariance and time. The entries are a ring allocated once, so recording a
+ * measurement does not allocate.
+ */
+template <class State>
+class MeasurementHistory {
+public:
+  struct Entry {
+    MeasurementPackage::SensorType sensor_type;
+    long long timestamp;
+    Eigen::Vector3d z;  // the first 2 (laser) or 3 (radar) values are set
+    bool has_state;     // false until state is saved after the measurement
+    State state;
+  };
+
+  /**
+   * Constructor
+   * @param capacity Maximum number of measurements kept; 0 keeps none, so late
+   *   measurements cannot be inserted
+   */
+  explicit MeasurementHistory(int capacity = 0) : entries_(capacity), first_(0), size_(0) {}
+
+  int Capacity() const {
+    return (int)entries_.size();
+  }
+
+  int Size() const {
+    return size_;
+  }
+
+  void Clear() {
+    first_ = 0;
+    size_ = 0;
+  }
+
+  // Entry i, 0 being the oldest
+  Entry& operator[](int i) {
+    return entries_[(first_ + i) % entries_.size()];
+  }
+
+  /**
+   * Insert Adds a measurement after the entries with the same or an earlier
+   * timestamp, dropping the oldest entry if the history is full
+   * @return Index of the new entry, or -1 if the history has no capacity or is
+   *   full and the measurement is older than all of it
+   */
+  int Insert(const MeasurementPackage& measurement) {
+    int index = Position(measurement.timestamp_);
+    if (size_ == Capacity() && index == 0) {
+      return -1;
+    }
+    return InsertAt(index, measurement);
+  }
+
+  /**
+   * InsertLate Adds a measurement as Insert does, but only if an entry with a
+   * saved state stays before it to resume from. Otherwise the history is left
+   * unchanged, so a full history does not drop its oldest entry for a
+   * measurement that cannot be applied.
+   * @param restore Set to the index of the latest entry with a saved state
+   *   before the new one, -1 if none
+   * @return Index of the new entry, or -1
+   */
+  int InsertLate(const MeasurementPackage& measurement, int& restore) {
+    int index = Position(measurement.timestamp_);
+    int dropped = size_ == Capacity() ? 1 : 0;
+    restore = RestorePoint(index) - dropped;
+    if (restore < 0) {
+      restore = -1;
+      return -1;
+    }
+    return InsertAt(index, measurement);
+  }
+
+  /**
+   * RestorePoint Index of the latest entry before index with a saved state, -1 if none
+   */
+  int RestorePoint(int index) {
+    for (int i = index - 1; i >= 0; i--) {
+      if ((*this)[i].has_state) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+private:
+  // Index after the entries with the same or an earlier timestamp
+  int Position(long long timestamp) {
+    int index = size_;
+    while (index > 0 && (*this)[index - 1].timestamp > timestamp) {
+      index--;
+    }
+    return index;
+  }
+
+  // Inserts at index, dropping the oldest entry first if the history is full
+  int InsertAt(int index, const MeasurementPackage& measurement) {
+    if (size_ == Capacity()) {
+      first_ = (first_ + 1) % entries_.size();
+      size_--;
+      index--;
+    }
+    for (int i = size_; i > index; i--) {
+      (*this)[i] = (*this)[i - 1];
+    }
+    size_++;
+
+    Entry& entry = (*this)[index];
+    entry.sensor_type = measurement.sensor_type_;
+    entry.timestamp = measurement.timestamp_;
+    entry.z.setZero();
+    for (int i = 0; i < measurement.raw_measurements_.size() && i < 3; i++) {
+      entry.z(i) = measurement.raw_measurements_(i);
+    }
+    entry.has_state = false;
+    return index;
+  }
+
+  std::vector<Entry, Eigen::aligned_allocator<Entry> > entries_;
+  int first_;
+  int size_;
+};
+
+#endif /* MEASUREMENT_HISTORY_H_ */
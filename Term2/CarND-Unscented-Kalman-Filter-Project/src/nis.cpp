@@ -0,0 +1,63 @@
+#include "nis.h"
+#include <math.h>
+
+double ChiSquare95(int dof) {
+  static const double quantiles[] = { 3.841, 5.991, 7.815, 9.488, 11.070, 12.592 };
+  if (dof < 1) {
+    dof = 1;
+  } else if (dof > 6) {
+    dof = 6;
+  }
+  return quantiles[dof - 1];
+}
+
+NISMonitor::NISMonitor(int dof, int window)
+    : dof_(dof), threshold_(ChiSquare95(dof)), window_(window > 0 ? window : 1) {
+  Reset();
+}
+
+void NISMonitor::Add(double nis) {
+  if (!isfinite(nis)) {
+    return;
+  }
+  last_ = nis;
+  count_++;
+  if (nis > threshold_) {
+    above_++;
+  }
+
+  //replace the oldest value of a full window
+  if (window_count_ == (int)window_.size()) {
+    double oldest = window_[window_next_];
+    window_sum_ -= oldest;
+    if (oldest > threshold_) {
+      window_above_--;
+    }
+  } else {
+    window_count_++;
+  }
+  window_[window_next_] = nis;
+  window_sum_ += nis;
+  if (nis > threshold_) {
+    window_above_++;
+  }
+  window_next_ = (window_next_ + 1) % window_.size();
+
+  //resum once per pass so that rounding in the running sum cannot accumulate
+  if (window_next_ == 0) {
+    window_sum_ = 0;
+    for (int i = 0; i < window_count_; i++) {
+      window_sum_ += window_[i];
+    }
+  }
+}
+
+void NISMonitor::Reset() {
+  last_ = 0;
+  count_ = 0;
+  above_ = 0;
+  window_next_ = 0;
+  window_count_ = 0;
+  window_above_ = 0;
+  window_sum_ = 0;
+}
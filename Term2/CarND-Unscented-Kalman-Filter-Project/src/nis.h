@@ -0,0 +1,89 @@
+#ifndef NIS_H
+#define NIS_H
+
+#include <vector>
+
+/**
+ * ChiSquare95 Returns the 95% quantile of the chi-square distribution
+ * @param dof Degrees of freedom, 1 to 6
+ */
+double ChiSquare95(int dof);
+
+/**
+ * Rolling statistics of the normalized innovation squared (NIS) of one kind of update.
+ *
+ * For a consistent filter the NIS of an NZ-dimensional measurement is
+ * chi-square distributed with NZ degrees of freedom: its mean is NZ and it
+ * exceeds ChiSquare95(NZ) 5% of the time. A higher mean or rate means the
+ * filter is overconfident, a lower one that it is too cautious.
+ * Adding a value and every query are O(1).
+ */
+class NISMonitor {
+public:
+  /**
+   * Constructor
+   * @param dof Dimension of the measurement
+   * @param window Number of recent updates the rolling statistics cover
+   */
+  explicit NISMonitor(int dof = 2, int window = 100);
+
+  /**
+   * Add Records the NIS of an update; non-finite values are ignored
+   */
+  void Add(double nis);
+
+  void Reset();
+
+  int Dof() const {
+    return dof_;
+  }
+
+  double Threshold() const {
+    return threshold_;
+  }
+
+  // NIS of the most recent update
+  double Last() const {
+    return last_;
+  }
+
+  // Updates recorded since construction or Reset
+  long long Count() const {
+    return count_;
+  }
+
+  // Updates in the rolling window
+  int WindowCount() const {
+    return window_count_;
+  }
+
+  // Mean NIS over the rolling window
+  double WindowMean() const {
+    return window_count_ > 0 ? window_sum_ / window_count_ : 0;
+  }
+
+  // Fraction of the updates in the rolling window above the 95% threshold
+  double WindowFractionAbove() const {
+    return window_count_ > 0 ? double(window_above_) / window_count_ : 0;
+  }
+
+  // Fraction of all updates above the 95% threshold
+  double FractionAbove() const {
+    return count_ > 0 ? double(above_) / count_ : 0;
+  }
+
+private:
+  int dof_;
+  double threshold_;
+  double last_;
+  long long count_;
+  long long above_;
+
+  std::vector<double> window_;  // ring of the recent values
+  int window_next_;
+  int window_count_;
+  int window_above_;
+  double window_sum_;
+};
+
+#endif /* NIS_H */
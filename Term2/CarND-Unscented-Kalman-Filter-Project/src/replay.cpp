@@ -0,0 +1,201 @@
+/*
+ * replay.cpp
+ *
+ * Offline driver: streams a recorded lidar/radar file through the UKF as fast
+ * as possible, without the simulator, and reports throughput, per-update
+ * latency percentiles and the RMSE against ground truth.
+ *
+ * Usage: UnscentedKF_replay [input_file] [--repeat n] [--sqrt] [--adapt] [--imm]
+ *
+ * Every line of input_file is a measurement as sent by the simulator:
+ *   L px py timestamp x_gt y_gt vx_gt vy_gt ...
+ *   R rho phi rho_dot timestamp x_gt y_gt vx_gt vy_gt ...
+ * --repeat runs the whole file n times, each with a new filter, for steadier timings;
+ * --sqrt and --adapt select the square-root filter and the process noise tuning,
+ * --imm runs the CV/CTRV IMM estimator instead of the UKF.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ukf.h"
+#include "imm.h"
+#include "tools.h"
+
+using namespace std;
+using Eigen::VectorXd;
+
+typedef chrono::steady_clock Clock;
+
+/*
+ * Reads the measurements and ground truth, parsed like the simulator driver
+ */
+static bool read_measurements(const string& file_name, vector<MeasurementPackage>& measurements,
+                              vector<VectorXd>& ground_truth) {
+  ifstream in(file_name.c_str());
+  if (!in) {
+    return false;
+  }
+  string line;
+  while (getline(in, line)) {
+    istringstream iss(line);
+    string sensor_type;
+    iss >> sensor_type;
+    MeasurementPackage meas_package;
+    long long timestamp;
+    if (sensor_type.compare("L") == 0) {
+      meas_package.sensor_type_ = MeasurementPackage::LASER;
+      meas_package.raw_measurements_ = VectorXd(2);
+      float px, py;
+      iss >> px >> py;
+      meas_package.raw_measurements_ << px, py;
+    } else if (sensor_type.compare("R") == 0) {
+      meas_package.sensor_type_ = MeasurementPackage::RADAR;
+      meas_package.raw_measurements_ = VectorXd(3);
+      float ro, theta, ro_dot;
+      iss >> ro >> theta >> ro_dot;
+      meas_package.raw_measurements_ << ro, theta, ro_dot;
+    } else {
+      continue;
+    }
+    iss >> timestamp;
+    meas_package.timestamp_ = timestamp;
+    float x_gt, y_gt, vx_gt, vy_gt;
+    iss >> x_gt >> y_gt >> vx_gt >> vy_gt;
+    VectorXd gt_values(4);
+    gt_values << x_gt, y_gt, vx_gt, vy_gt;
+    measurements.push_back(meas_package);
+    ground_truth.push_back(gt_values);
+  }
+  return true;
+}
+
+/*
+ * Prints count and latency percentiles of one kind of update
+ */
+static void print_latency(const char* name, vector<double>& latency) {
+  cout << name;
+  if (latency.empty()) {
+    cout << "none" << endl;
+    return;
+  }
+  sort(latency.begin(), latency.end());
+  const double percentiles[] = { 0.5, 0.9, 0.99 };
+  cout << setw(8) << latency.size() << " updates ";
+  for (int i = 0; i < 3; i++) {
+    size_t index = min(latency.size() - 1, (size_t)(percentiles[i] * latency.size()));
+    cout << " p" << (int)(100 * percentiles[i]) << " " << setw(7) << 1e6 * latency[index];
+  }
+  cout << "  max " << setw(7) << 1e6 * latency.back() << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  // the recording shipped with the EKF project, seen from a build directory
+  string input_file = "../../CarND-Extended-Kalman-Filter-Project/data/obj_pose-laser-radar-synthetic-input.txt";
+  int repeat = 1;
+  bool square_root = false;
+  bool adapt_noise = false;
+  bool use_imm = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+      repeat = max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--sqrt")) {
+      square_root = true;
+    } else if (!strcmp(argv[i], "--adapt")) {
+      adapt_noise = true;
+    } else if (!strcmp(argv[i], "--imm")) {
+      use_imm = true;
+    } else if (argv[i][0] != '-') {
+      input_file = argv[i];
+    } else {
+      cerr << "Usage: " << argv[0] << " [input_file] [--repeat n] [--sqrt] [--adapt] [--imm]" << endl;
+      return -1;
+    }
+  }
+
+  vector<MeasurementPackage> measurements;
+  vector<VectorXd> ground_truth;
+  if (!read_measurements(input_file, measurements, ground_truth) || measurements.empty()) {
+    cout << "Error: Could not read measurements from " << input_file << endl;
+    return -1;
+  }
+
+  // Everything the timed loop writes is allocated up front
+  size_t total = measurements.size() * repeat;
+  vector<double> laser_latency, radar_latency;
+  laser_latency.reserve(total);
+  radar_latency.reserve(total);
+  vector<VectorXd> estimations(measurements.size(), VectorXd(4));
+
+  double total_time = 0;
+  double nis_above[2] = {0, 0};
+  double ctrv_probability = 0;
+  for (int pass = 0; pass < repeat; pass++) {
+    UKF ukf;
+    ukf.square_root_ = square_root;
+    ukf.adapt_noise_ = adapt_noise;
+    IMM imm;
+    ctrv_probability = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < measurements.size(); i++) {
+      Clock::time_point t0 = Clock::now();
+      if (use_imm) {
+        imm.ProcessMeasurement(measurements[i]);
+      } else {
+        ukf.ProcessMeasurement(measurements[i]);
+      }
+      Clock::time_point t1 = Clock::now();
+
+      // the first measurement only initializes the filter
+      if (i > 0) {
+        double latency = chrono::duration<double>(t1 - t0).count();
+        if (measurements[i].sensor_type_ == MeasurementPackage::LASER) {
+          laser_latency.push_back(latency);
+        } else {
+          radar_latency.push_back(latency);
+        }
+      }
+      // position and velocity components, as sent to the simulator
+      const UKF::StateVector& x = use_imm ? imm.x_ : ukf.x_;
+      VectorXd& estimate = estimations[i];
+      estimate(0) = x(0);
+      estimate(1) = x(1);
+      estimate(2) = cos(x(3))*x(2);
+      estimate(3) = sin(x(3))*x(2);
+      ctrv_probability += imm.ModeProbability(1) / measurements.size();
+    }
+    total_time += chrono::duration<double>(Clock::now() - start).count();
+    nis_above[0] = ukf.NIS(LidarModel::NZ).FractionAbove();
+    nis_above[1] = ukf.NIS(RadarModel::NZ).FractionAbove();
+  }
+
+  // Every pass gives the same estimates
+  Tools tools;
+  VectorXd rmse = tools.CalculateRMSE(estimations, ground_truth);
+
+  cout << fixed << setprecision(4);
+  cout << "Measurements:     " << measurements.size() << " x " << repeat << " pass(es)" << endl;
+  cout << "RMSE x/y/vx/vy:   " << rmse(0) << " " << rmse(1) << " " << rmse(2) << " " << rmse(3) << endl;
+  cout << setprecision(2);
+  cout << "Latency [us]:" << endl;
+  print_latency("  laser ", laser_latency);
+  print_latency("  radar ", radar_latency);
+  if (use_imm) {
+    cout << "CTRV mode:        " << 100 * ctrv_probability << "% mean probability" << endl;
+  } else {
+    cout << "NIS above 95%:    laser " << 100 * nis_above[0] << "%  radar " << 100 * nis_above[1] << "%" << endl;
+  }
+  cout << "Runtime:          " << total_time << " s, " << setprecision(0) << total / total_time
+       << " measurements/s" << endl;
+
+  return 0;
+}
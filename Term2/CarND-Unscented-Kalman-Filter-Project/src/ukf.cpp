@@ -1,6 +1,9 @@
 #include "ukf.h"
+#include "trace.h"
 #include "Eigen/Dense"
+#include <algorithm>
 #include <iostream>
+#include <math.h>
 
 using namespace std;
 using Eigen::MatrixXd;
@@ -11,19 +14,13 @@ using std::vector;
  * Initializes Unscented Kalman filter
  * This is scaffolding, do not modify
  */
-UKF::UKF() {
+UKF::UKF() : UKFCore<CTRVModel::NX, CTRVModel::NAUG>(CTRVModel::YAW) {
   // if this is false, laser measurements will be ignored (except during init)
   use_laser_ = true;
 
   // if this is false, radar measurements will be ignored (except during init)
   use_radar_ = true;
 
-  // initial state vector
-  x_ = VectorXd(5);
-
-  // initial covariance matrix
-  P_ = MatrixXd(5, 5);
-
   // Process noise standard deviation longitudinal acceleration in m/s^2
   std_a_ = 2;
 
@@ -47,21 +44,41 @@ UKF::UKF() {
   std_radrd_ = 0.3;
   //DO NOT MODIFY measurement noise values above these are provided by the sensor manufacturer.
 
-  ///* Weights of sigma points
-  VectorXd weights_;
-
   ///* State dimension
   n_x_ = 5;
 
   ///* Augmented state dimension
   n_aug_ = 7;
 
-  ///* Sigma point spreading parameter
-  lambda_ = 3 - 7; // 3 - n_aug_
+  ///* Sigma point spreading parameter, also sets the weights of sigma points
+  SetLambda(3 - n_aug_);
+
+  // propagate the Cholesky factor of P instead of P (square-root UKF)
+  square_root_ = false;
 
   is_initialized_ = false; // awaiting first measurement
   time_us_ = 0.0;
   TimeStep_ = 0;
+
+  // only measurements with the same timestamp are fused
+  fusion_window_us_ = 0;
+
+  for (int dimension = 1; dimension < 7; dimension++) {
+    nis_[dimension] = NISMonitor(dimension);
+  }
+
+  // process noise tuning from the NIS, off by default
+  adapt_noise_ = false;
+  noise_adapt_rate_ = 0.02;
+  std_a_nominal_ = std_a_;
+  std_yawdd_nominal_ = std_yawdd_;
+  noise_scale_ = 1;
+  noise_scale_min_ = 0.2;
+  noise_scale_max_ = 5;
+
+  // late measurements up to this many measurements back are inserted in order
+  history_ = History(64);
+  replaying_ = false;
 }
 
 UKF::~UKF() {}
@@ -75,22 +92,22 @@ void UKF::ProcessMeasurement(MeasurementPackage &meas_package) {
   Make sure you switch between lidar and radar
   measurements.
   */
+   TRACE_SCOPE("ukf.process");
    TimeStep_ ++;
-   cout << "Start ProcessMeasurement " << TimeStep_ << endl;
+   TRACE_LOG("Start ProcessMeasurement " << TimeStep_);
   /*****************************************************************************
    *  Initialization
    ****************************************************************************/
   if (!is_initialized_) {
     // first measurement
-    cout << "UKF: " << endl;
-    x_ = VectorXd(n_x_);
     //state covariance matrix P
-    P_ = MatrixXd(n_x_, n_x_);
-    P_ <<     .2, 0, 0, 0, 0,
+    StateMatrix P;
+    P <<      .2, 0, 0, 0, 0,
               0, .2, 0, 0,  0,
               0, 0, 2, 0,  0,
               0, 0, 0, .1, 0,         
               0, 0, 0, 0,  .1;         
+    SetCovariance(P);
 
     if (meas_package.sensor_type_ == MeasurementPackage::RADAR) {
       x_ << meas_package.raw_measurements_(0)*cos(meas_package.raw_measurements_(1)), 
@@ -106,13 +123,26 @@ void UKF::ProcessMeasurement(MeasurementPackage &meas_package) {
                 0,
                 0; // lidar does'nt give us any velocity mearement
     }
+    // the process noise tuning starts from the configured values
+    std_a_nominal_ = std_a_;
+    std_yawdd_nominal_ = std_yawdd_;
+    noise_scale_ = 1;
+
     // done initializing, no need to predict or update
     is_initialized_ = true;
-    cout << "is_initialized_ using " << meas_package.sensor_type_ << endl;
+    TRACE_LOG("is_initialized_ using " << meas_package.sensor_type_);
     time_us_ = meas_package.timestamp_;
+    history_.Clear();
+    SaveState(history_.Insert(meas_package));
     return;
   }
 
+  if (meas_package.timestamp_ < time_us_) {
+    ProcessLateMeasurement(meas_package);
+    return;
+  }
+  int index = history_.Insert(meas_package);
+
   /*****************************************************************************
    *  Prediction
    ****************************************************************************/
@@ -134,277 +164,188 @@ void UKF::ProcessMeasurement(MeasurementPackage &meas_package) {
     UpdateRadar(meas_package);
   }
 
-    //angle normalization
-  while (x_(3)> M_PI) x_(3)-=2.*M_PI;
-  while (x_(3)<-M_PI) x_(3)+=2.*M_PI;
-  //print result
-  cout << "Updated state x: " << endl << x_ << endl;
-  cout << "Updated state covariance P: " << endl << P_ << endl;
-  cout << "using: " << meas_package.sensor_type_ << endl;
-  cout << "at time_us " << time_us_ << endl; 
-  cout << "End ProcessMeasurement " << TimeStep_ << endl;
+  //angle normalization
+  x_(3) = NormalizeAngle(x_(3));
+  TRACE_STATE("ukf.x", time_us_, x_);
+  TRACE_STATE("ukf.P", time_us_, P_);
+  TRACE_LOG("Updated state x: " << endl << x_);
+  TRACE_LOG("Updated state covariance P: " << endl << P_);
+  TRACE_LOG("using: " << meas_package.sensor_type_ << " at time_us " << time_us_);
+  SaveState(index);
 }
 
-/*
- * Predicts sigma points, the state, and the state covariance matrix.
- * @param {double} delta_t the change in time (in seconds) between the last
- * measurement and this one.
+/**
+ * @param {vector<MeasurementPackage>} packages Measurements in time order
  */
-void UKF::Prediction(double & delta_t) {
-  /*
-  Estimate the object's location. Modify the state
-  vector, x_. Predict sigma points, the state, and the state covariance matrix.
-  */
-  /*****************************************************************************
-   *  Generate sigma points
-   ****************************************************************************/
-  cout << "Start Prediction" << endl;
-  // number of sigma points = 2*n + 1
-  Xsig_pred_ = MatrixXd(n_x_, 2 * n_x_ + 1);
-
-  //create augmented mean vector
-  VectorXd x_aug = VectorXd(n_aug_);
-
-  //create augmented state covariance
-  MatrixXd P_aug = MatrixXd(n_aug_, n_aug_);
-
-  //create sigma point matrix
-  MatrixXd Xsig_aug = MatrixXd(n_aug_, 2 * n_aug_ + 1);
-
-  //create augmented mean state
-  x_aug.head(n_x_) = x_;
-  x_aug(n_aug_ - 1) = 0; // zero mean
-  x_aug(n_aug_ - 2) = 0; // zero mean
-
-  //create augmented covariance matrix
-  P_aug.fill(0.0);
-  P_aug.topLeftCorner(n_x_, n_x_) = P_;
-  P_aug(n_aug_ - 2, n_aug_ - 2) = std_a_*std_a_; // Q
-  P_aug(n_aug_ - 1, n_aug_ - 1) = std_yawdd_*std_yawdd_; // Q
-
-  //create square root matrix
-  MatrixXd L = P_aug.llt().matrixL();
-
-  //create augmented sigma points
-  Xsig_aug.col(0)  = x_aug;
-  for (int i = 0; i< n_aug_; i++)
-  {
-    Xsig_aug.col(i+1)        = x_aug + sqrt(lambda_+n_aug_) * L.col(i);
-    Xsig_aug.col(i+1+n_aug_) = x_aug - sqrt(lambda_+n_aug_) * L.col(i);
-  }
-
-
-  cout << "Augment State" << endl;
-
-  /*****************************************************************************
-   *  Predict sigma points
-   ****************************************************************************/
-
-  //create matrix with predicted sigma points as columns
-  Xsig_pred_ = MatrixXd(n_x_, 2 * n_aug_ + 1);
+void UKF::ProcessMeasurements(vector<MeasurementPackage> &packages) {
+  TRACE_SCOPE("ukf.process_group");
+
+  size_t begin = 0;
+  while (begin < packages.size()) {
+    if (is_initialized_ && packages[begin].timestamp_ < time_us_) {
+      //late, inserted through the history
+      ProcessMeasurement(packages[begin]);
+      begin++;
+      continue;
+    }
 
-  //predict sigma points
-  for (int i = 0; i< 2*n_aug_+1; i++)
-  {
-    //extract values for better readability
-    double p_x = Xsig_aug(0,i);
-    double p_y = Xsig_aug(1,i);
-    double v = Xsig_aug(2,i);
-    double yaw = Xsig_aug(3,i);
-    double yawd = Xsig_aug(4,i);
-    double nu_a = Xsig_aug(5,i);
-    double nu_yawdd = Xsig_aug(6,i);
-
-    //predicted state values
-    double px_p, py_p;
-
-    //avoid division by zero
-    if (fabs(yawd) > 0.001) 
-    {
-        px_p = p_x + v/yawd * ( sin (yaw + yawd*delta_t) - sin(yaw));
-        py_p = p_y + v/yawd * ( cos(yaw) - cos(yaw+yawd*delta_t) );
+    //group the measurements within the fusion window, skipping disabled sensors
+    size_t end = begin + 1;
+    while (end < packages.size() && packages[end].timestamp_ - packages[begin].timestamp_ <= fusion_window_us_) {
+      end++;
     }
-    else 
-    {
-        px_p = p_x + v*delta_t*cos(yaw);
-        py_p = p_y + v*delta_t*sin(yaw);
+    vector<MeasurementPackage*> & group = fusion_group_;
+    group.clear();
+    for (size_t i = begin; i < end; i++) {
+      if ((packages[i].sensor_type_ == MeasurementPackage::LASER && use_laser_) ||
+          (packages[i].sensor_type_ == MeasurementPackage::RADAR && use_radar_)) {
+        group.push_back(&packages[i]);
+      }
+    }
+    if (!is_initialized_ || group.size() < 2) {
+      //nothing to fuse
+      for (size_t i = begin; i < end; i++) {
+        ProcessMeasurement(packages[i]);
+      }
+      begin = end;
+      continue;
     }
 
-    double v_p = v;
-    double yaw_p = yaw + yawd*delta_t;
-    double yawd_p = yawd;
-
-    //add noise
-    px_p = px_p + 0.5*nu_a*delta_t*delta_t * cos(yaw);
-    py_p = py_p + 0.5*nu_a*delta_t*delta_t * sin(yaw);
-    v_p = v_p + nu_a*delta_t;
-
-    yaw_p = yaw_p + 0.5*nu_yawdd*delta_t*delta_t;
-    yawd_p = yawd_p + nu_yawdd*delta_t;
-
-    //write predicted sigma point into right column
-    Xsig_pred_(0,i) = px_p;
-    Xsig_pred_(1,i) = py_p;
-    Xsig_pred_(2,i) = v_p;
-    Xsig_pred_(3,i) = yaw_p;
-    Xsig_pred_(4,i) = yawd_p;
-
-  }
-  cout << "Predict sigma points" << endl;
-
-   /*****************************************************************************
-   *  Predict mean and covariance
-   ****************************************************************************/
-
-
-  weights_ = VectorXd(2*n_aug_+1);
-
-  // set weights
-  weights_(0) = lambda_/(lambda_+n_aug_);
-  for (int i=1; i<2*n_aug_+1; i++) 
-  {  //2n+1 weights
-    weights_(i) = 0.5/(n_aug_+lambda_);
-  }
-
-  cout << "weights state" << endl;
-
-  //predicted state mean
-  x_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) 
-  {  //iterate over sigma points
-    x_ = x_+ weights_(i) * Xsig_pred_.col(i);
-  }
-
-  //predicted state covariance matrix
-  P_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) 
-  {  //iterate over sigma points
+    TimeStep_ += group.size();
+    //the state is saved after the whole group only
+    int index = -1;
+    for (size_t i = 0; i < group.size(); i++) {
+      index = history_.Insert(*group[i]);
+    }
+    double delta_t = (group.back()->timestamp_ - time_us_)*1e-6; // us to seconds;
+    time_us_ = group.back()->timestamp_;
+    Prediction(delta_t);
+    for (size_t i = 0; i < group.size(); i += 2) {
+      if (i > 0) {
+        //sigma points of the updated state
+        double no_time = 0;
+        Prediction(no_time);
+      }
+      if (i + 1 < group.size()) {
+        UpdateFused(*group[i], *group[i + 1]);
+      } else if (group[i]->sensor_type_ == MeasurementPackage::LASER) {
+        UpdateLidar(*group[i]);
+      } else {
+        UpdateRadar(*group[i]);
+      }
+    }
 
-    // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
     //angle normalization
-    while (x_diff(3)> M_PI) x_diff(3)-=2.*M_PI;
-    while (x_diff(3)<-M_PI) x_diff(3)+=2.*M_PI;
-
-    P_ = P_ + weights_(i) * x_diff * x_diff.transpose() ;
+    x_(3) = NormalizeAngle(x_(3));
+    TRACE_STATE("ukf.x", time_us_, x_);
+    TRACE_STATE("ukf.P", time_us_, P_);
+    TRACE_LOG("Fused " << group.size() << " measurements at time_us " << time_us_);
+    SaveState(index);
+    begin = end;
   }
-  
-
-  //angle normalization
-  while (x_(3)> M_PI) x_(3)-=2.*M_PI;
-  while (x_(3)<-M_PI) x_(3)+=2.*M_PI;
-  //print result
-  cout << "Predicted state" << endl;
-  cout << x_ << endl;
-  cout << "Predicted covariance matrix" << endl;
-  cout << P_ << endl;
-
 }
 
 /**
- * Updates the state and the state covariance matrix using a laser measurement.
- * @param {MeasurementPackage} meas_package
+ * @param {MeasurementPackage} meas_package A measurement older than time_us_
  */
-void UKF::UpdateLidar(MeasurementPackage & meas_package) {
-  /**
-  Use lidar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
-
-  You'll also need to calculate the lidar NIS.
-  */
- 
-   /*****************************************************************************
-   *  Predict measurement mean and covariance
-   ****************************************************************************/
-  cout << "Start UpdateLidar" << endl;
-
-  VectorXd z  = meas_package.raw_measurements_;
-  int n_z = 2;
- 
-  //create matrix for sigma points in measurement space
-  MatrixXd Zsig = MatrixXd(n_z, 2 * n_aug_ + 1);
+void UKF::ProcessLateMeasurement(MeasurementPackage &meas_package) {
+  TRACE_SCOPE("ukf.process_late");
 
-  //mean predicted measurement
-  VectorXd z_pred = VectorXd(n_z);
-  
-  //measurement covariance matrix S
-  MatrixXd S = MatrixXd(n_z,n_z);
-
-   /*****************************************************************************
-   *  Transform sigma points to measurement space
-   ****************************************************************************/
-
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) 
-  {  //2n+1 simga points
-
-    // measurement model
-    Zsig(0,i) = Xsig_pred_(0,i);                        //px
-    Zsig(1,i) = Xsig_pred_(1,i);                        //py
+  int restore;
+  int index = history_.InsertLate(meas_package, restore);
+  if (index < 0) {
+    TRACE_LOG("Dropped measurement at " << meas_package.timestamp_ << ", older than the history");
+    return;
+  }
+  TRACE_LOG("Late measurement at " << meas_package.timestamp_ << ", re-applying "
+            << history_.Size() - index << " measurements");
+
+  const SavedState & saved = history_[restore].state;
+  x_ = saved.x;
+  P_ = saved.P;
+  S_ = saved.S;
+  time_us_ = saved.time_us;
+  std_a_ = saved.std_a;
+  std_yawdd_ = saved.std_yawdd;
+  noise_scale_ = saved.noise_scale;
+
+  //the measurements after the inserted one are already in the NIS statistics
+  for (int i = restore + 1; i < history_.Size(); i++) {
+    replaying_ = i != index;
+    ApplyEntry(history_[i]);
+    SaveState(i);
   }
+  replaying_ = false;
+  TRACE_STATE("ukf.x", time_us_, x_);
+  TRACE_STATE("ukf.P", time_us_, P_);
+}
 
-  /*****************************************************************************
-   *  Prediction measurement mean and covariance
-   ****************************************************************************/
+/**
+ * @param {History::Entry} entry A measurement of the history
+ */
+void UKF::ApplyEntry(const History::Entry &entry) {
+  double delta_t = (entry.timestamp - time_us_)*1e-6; // us to seconds;
+  time_us_ = entry.timestamp;
+  Prediction(delta_t);
 
-  //mean predicted measurement
-  z_pred.fill(0.0);
-  for (int i=0; i < 2*n_aug_+1; i++) 
+  if ((entry.sensor_type ==  MeasurementPackage::LASER) && use_laser_)
   {
-      z_pred = z_pred + weights_(i) * Zsig.col(i);
+    LidarModel::MeasVector z = entry.z.head<LidarModel::NZ>();
+    RecordNIS(Update(z, LidarNoise(), LidarModel()), LidarModel::NZ);
   }
-
-  //innovation covariance matrix S
-  S.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) 
-  {  //2n+1 sigma points
-    //residual
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-    S = S + weights_(i) * z_diff * z_diff.transpose();
+  else if ((entry.sensor_type ==  MeasurementPackage::RADAR) && use_radar_)
+  {
+    RadarModel::MeasVector z = entry.z.head<RadarModel::NZ>();
+    RecordNIS(Update(z, RadarNoise(), RadarModel()), RadarModel::NZ);
   }
 
-  //add measurement noise covariance matrix
-  MatrixXd R = MatrixXd(n_z,n_z);
-  R <<    std_laspx_*std_laspx_, 0,
-          0, std_laspy_*std_laspy_;
-  S = S + R;
-
-  //create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd(n_x_, n_z);
-
-  //calculate cross correlation matrix
-  Tc.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-
-    //residual
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-
-    // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    //angle normalization
-    while (x_diff(3)> M_PI) x_diff(3)-=2.*M_PI;
-    while (x_diff(3)<-M_PI) x_diff(3)+=2.*M_PI;
+  //angle normalization
+  x_(3) = NormalizeAngle(x_(3));
+}
 
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
+/**
+ * @param {int} index History entry, -1 for none
+ */
+void UKF::SaveState(int index) {
+  if (index < 0) {
+    return;
   }
+  History::Entry & entry = history_[index];
+  entry.state.x = x_;
+  entry.state.P = P_;
+  entry.state.S = S_;
+  entry.state.time_us = time_us_;
+  entry.state.std_a = std_a_;
+  entry.state.std_yawdd = std_yawdd_;
+  entry.state.noise_scale = noise_scale_;
+  entry.has_state = true;
+}
 
-  //Kalman gain K;
-  MatrixXd K = Tc * S.inverse();
+/*
+ * Predicts sigma points, the state, and the state covariance matrix.
+ * @param {double} delta_t the change in time (in seconds) between the last
+ * measurement and this one.
+ */
+void UKF::Prediction(double & delta_t) {
+  TRACE_SCOPE("ukf.predict");
 
-  //residual
-  VectorXd z_diff = z - z_pred;
+  NoiseVector noise_std;
+  noise_std << std_a_, std_yawdd_;
+  Predict(delta_t, noise_std, CTRVModel());
 
-  //angle normalization
-  while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
-  while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
+  TRACE_LOG("Predicted state" << endl << x_);
+  TRACE_LOG("Predicted covariance matrix" << endl << P_);
+}
 
-  cout << "z_diff = \n" <<  z_diff << endl; 
-   /*****************************************************************************
-   *  Update state
-   ****************************************************************************/
-  //update state mean and covariance matrix
-  x_ = x_ + K * z_diff;
-  P_ = P_ - K*S*K.transpose();
-  cout << "End UpdateLidar" << endl;
+/**
+ * Updates the state and the state covariance matrix using a laser measurement.
+ * @param {MeasurementPackage} meas_package
+ */
+void UKF::UpdateLidar(MeasurementPackage & meas_package) {
+  TRACE_SCOPE("ukf.update_lidar");
+
+  LidarModel::MeasVector z = meas_package.raw_measurements_.head<LidarModel::NZ>();
+  RecordNIS(Update(z, LidarNoise(), LidarModel()), LidarModel::NZ);
 }
 
 /**
@@ -412,122 +353,78 @@ void UKF::UpdateLidar(MeasurementPackage & meas_package) {
  * @param {MeasurementPackage} meas_package
  */
 void UKF::UpdateRadar(MeasurementPackage & meas_package) {
-  /**
-  Use radar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
-
-  You'll also need to calculate the radar NIS.
-  */
-  cout << "Start UpdateRadar" << endl;
-
-  VectorXd z  = meas_package.raw_measurements_;
-  int n_z = 3;
- 
-  //create matrix for sigma points in measurement space
-  MatrixXd Zsig = MatrixXd(n_z, 2 * n_aug_ + 1);
-
-  //mean predicted measurement
-  VectorXd z_pred = VectorXd(n_z);
-  
-  //measurement covariance matrix S
-  MatrixXd S = MatrixXd(n_z,n_z);
-
-   /*****************************************************************************
-   *  Transform sigma points to measurement space
-   ****************************************************************************/
-
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) 
-  {  //2n+1 simga points
+  TRACE_SCOPE("ukf.update_radar");
 
-    // extract values for better readibility
-    double p_x = Xsig_pred_(0,i);
-    double p_y = Xsig_pred_(1,i);
-    double v   = Xsig_pred_(2,i);
-    double yaw = Xsig_pred_(3,i);
-
-    double v1 = cos(yaw)*v;
-    double v2 = sin(yaw)*v;
+  RadarModel::MeasVector z = meas_package.raw_measurements_.head<RadarModel::NZ>();
+  RecordNIS(Update(z, RadarNoise(), RadarModel()), RadarModel::NZ);
+}
 
-    // measurement model
-    Zsig(0,i) = sqrt(p_x*p_x + p_y*p_y);                        //r
-    Zsig(1,i) = atan2(p_y,p_x);                                 //phi
-    Zsig(2,i) = (p_x*v1 + p_y*v2 ) / sqrt(p_x*p_x + p_y*p_y);   //r_dot
+/**
+ * Updates the state and the state covariance matrix using two simultaneous measurements.
+ * @param {MeasurementPackage} first, second
+ */
+void UKF::UpdateFused(MeasurementPackage & first, MeasurementPackage & second) {
+  TRACE_SCOPE("ukf.update_fused");
+
+  //radar first if the sensors differ, so there are three stacked models
+  MeasurementPackage & a = first.sensor_type_ == MeasurementPackage::RADAR ? first : second;
+  MeasurementPackage & b = first.sensor_type_ == MeasurementPackage::RADAR ? second : first;
+  int dimension = a.raw_measurements_.size() + b.raw_measurements_.size();
+  double nis;
+
+  if (b.sensor_type_ == MeasurementPackage::RADAR) {
+    typedef StackedModel<RadarModel, RadarModel> Model;
+    nis = Update(Model::Stack(a.raw_measurements_.head<RadarModel::NZ>(), b.raw_measurements_.head<RadarModel::NZ>()),
+           Model::StackNoise(RadarNoise(), RadarNoise()), Model());
+  } else if (a.sensor_type_ == MeasurementPackage::RADAR) {
+    typedef StackedModel<RadarModel, LidarModel> Model;
+    nis = Update(Model::Stack(a.raw_measurements_.head<RadarModel::NZ>(), b.raw_measurements_.head<LidarModel::NZ>()),
+           Model::StackNoise(RadarNoise(), LidarNoise()), Model());
+  } else {
+    typedef StackedModel<LidarModel, LidarModel> Model;
+    nis = Update(Model::Stack(a.raw_measurements_.head<LidarModel::NZ>(), b.raw_measurements_.head<LidarModel::NZ>()),
+           Model::StackNoise(LidarNoise(), LidarNoise()), Model());
   }
+  RecordNIS(nis, dimension);
+}
 
-  /*****************************************************************************
-   *  Prediction measurement mean and covariance
-   ****************************************************************************/
-
-  //mean predicted measurement
-  z_pred.fill(0.0);
-  for (int i=0; i < 2*n_aug_+1; i++) 
-  {
-      z_pred = z_pred + weights_(i) * Zsig.col(i);
+/**
+ * Records the NIS of an update and tunes the process noise.
+ * @param {double} nis
+ * @param {int} dimension of the measurement
+ */
+void UKF::RecordNIS(double nis, int dimension) {
+  if (!replaying_) {
+    nis_[dimension].Add(nis);
+  }
+  TRACE_LOG("NIS " << nis << " of a " << dimension << "-dimensional update");
+  if (!adapt_noise_ || !isfinite(nis)) {
+    return;
   }
 
-  //innovation covariance matrix S
-  S.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) 
-  {  //2n+1 sigma points
-    //residual
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-
-    //angle normalization
-    while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
-    while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
+  //a consistent filter has a mean NIS of the measurement dimension: raise the
+  //process noise while the innovations are larger than the filter predicts and
+  //lower it while they are smaller, limiting the pull of single outliers
+  double ratio = std::min(nis / dimension, 4.0);
+  noise_scale_ *= exp(noise_adapt_rate_ * (ratio - 1));
+  noise_scale_ = std::max(noise_scale_min_, std::min(noise_scale_max_, noise_scale_));
+  std_a_ = std_a_nominal_ * noise_scale_;
+  std_yawdd_ = std_yawdd_nominal_ * noise_scale_;
+}
 
-    S = S + weights_(i) * z_diff * z_diff.transpose();
-  }
+LidarModel::MeasMatrix UKF::LidarNoise() const {
+  //measurement noise covariance matrix
+  LidarModel::MeasMatrix R;
+  R <<    std_laspx_*std_laspx_, 0,
+          0, std_laspy_*std_laspy_;
+  return R;
+}
 
-  //add measurement noise covariance matrix
-  MatrixXd R = MatrixXd(n_z,n_z);
+RadarModel::MeasMatrix UKF::RadarNoise() const {
+  //measurement noise covariance matrix
+  RadarModel::MeasMatrix R;
   R <<    std_radr_*std_radr_, 0, 0,
           0, std_radphi_*std_radphi_, 0,
           0, 0,std_radrd_*std_radrd_;
-  S = S + R;
-
-  //create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd(n_x_, n_z);
-
-  //calculate cross correlation matrix
-  Tc.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-
-    //residual
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-    //angle normalization
-    while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
-    while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
-
-    // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    //angle normalization
-    while (x_diff(3)> M_PI) x_diff(3)-=2.*M_PI;
-    while (x_diff(3)<-M_PI) x_diff(3)+=2.*M_PI;
-
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
-  }
-
-  //Kalman gain K;
-  MatrixXd K = Tc * S.inverse();
-
-  //residual
-  VectorXd z_diff = z - z_pred;
-
-  //angle normalization
-  while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
-  while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
-
-  cout << "z_diff = \n" <<  z_diff << endl; 
-
-  /*****************************************************************************
-   *  Update
-   ****************************************************************************/
-
-  //update state mean and covariance matrix
-  x_ = x_ + K * z_diff;
-  P_ = P_ - K*S*K.transpose();
-
-  cout << "End UpdateRadar" << endl;
-
+  return R;
 }
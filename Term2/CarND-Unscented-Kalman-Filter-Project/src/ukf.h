@@ -2,6 +2,9 @@
 #define UKF_H
 
 #include "measurement_package.h"
+#include "ukf_core.h"
+#include "nis.h"
+#include "measurement_history.h"
 #include "Eigen/Dense"
 #include <vector>
 #include <string>
@@ -10,7 +13,7 @@
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 
-class UKF {
+class UKF : public UKFCore<CTRVModel::NX, CTRVModel::NAUG> {
 public:
 
   ///* initially set to false, set to true in first call of ProcessMeasurement
@@ -22,14 +25,8 @@ public:
   ///* if this is false, radar measurements will be ignored (except for init)
   bool use_radar_;
 
-  ///* state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-  VectorXd x_;
-
-  ///* state covariance matrix
-  MatrixXd P_;
-
-  ///* predicted sigma points matrix
-  MatrixXd Xsig_pred_;
+  // x_ (state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad),
+  // P_, Xsig_pred_, weights_ and lambda_ are fixed-size members of UKFCore
 
   ///* time when the state is true, in us
   long long time_us_;
@@ -55,20 +52,58 @@ public:
   ///* Radar measurement noise standard deviation radius change in m/s
   double std_radrd_ ;
 
-  ///* Weights of sigma points
-  VectorXd weights_;
-
   ///* State dimension
   int n_x_;
 
   ///* Augmented state dimension
   int n_aug_;
 
-  ///* Sigma point spreading parameter
-  double lambda_;
-
   int TimeStep_;
 
+  ///* ProcessMeasurements fuses measurements at most this far apart, in us
+  long long fusion_window_us_;
+
+  ///* measurements of the group being fused, reused between calls
+  std::vector<MeasurementPackage*> fusion_group_;
+
+  ///* NIS statistics of the updates by measurement dimension: 2 lidar, 3 radar,
+  ///* 4 to 6 fused pairs (lidar+lidar, radar+lidar, radar+radar); query with NIS()
+  NISMonitor nis_[7];
+
+  ///* if this is true, std_a_ and std_yawdd_ are tuned online from the NIS
+  bool adapt_noise_;
+
+  ///* step of the tuning per update, in log scale per unit of NIS / dimension - 1
+  double noise_adapt_rate_;
+
+  ///* std_a_ and std_yawdd_ at initialization, the tuning stays within
+  ///* noise_scale_min_ to noise_scale_max_ times these
+  double std_a_nominal_;
+  double std_yawdd_nominal_;
+  double noise_scale_;
+  double noise_scale_min_;
+  double noise_scale_max_;
+
+  ///* filter state saved in the history after a measurement
+  struct SavedState {
+    StateVector x;
+    StateMatrix P;
+    StateMatrix S;
+    long long time_us;
+    double std_a;
+    double std_yawdd;
+    double noise_scale;
+  };
+  typedef MeasurementHistory<SavedState> History;
+
+  ///* latest measurements with the state after them: a measurement older than
+  ///* time_us_ is inserted at its time and the newer ones are re-applied, one older
+  ///* than the whole history is dropped. Set to History(n) to keep n, 0 to keep none
+  History history_;
+
+  ///* true while measurements that are already in nis_ are re-applied
+  bool replaying_;
+
   /**
    * Constructor
    */
@@ -85,6 +120,33 @@ public:
    */
   void ProcessMeasurement(MeasurementPackage & meas_package);
 
+  /**
+   * ProcessMeasurements Processes measurements in time order. Measurements within
+   * fusion_window_us_ of the first of a group are predicted to the last one's
+   * timestamp together and applied in pairs as one stacked update each; the sigma
+   * points are only regenerated between the pairs of a group.
+   * @param packages The latest measurements of radar and/or laser
+   */
+  void ProcessMeasurements(std::vector<MeasurementPackage> & packages);
+
+  /**
+   * ProcessLateMeasurement Inserts a measurement older than time_us_ into the
+   * history, restores the latest state saved before it and re-applies the
+   * measurements from there on
+   * @param meas_package A measurement of radar or laser
+   */
+  void ProcessLateMeasurement(MeasurementPackage & meas_package);
+
+  /**
+   * ApplyEntry Predicts to the time of a history entry and updates with its measurement
+   */
+  void ApplyEntry(const History::Entry & entry);
+
+  /**
+   * SaveState Saves the state in history entry index, if index is not -1
+   */
+  void SaveState(int index);
+
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
    * matrix
@@ -103,6 +165,35 @@ public:
    * @param meas_package The measurement at k+1
    */
   void UpdateRadar(MeasurementPackage & meas_package);
+
+  /**
+   * Updates the state and the state covariance matrix using two measurements
+   * taken at the same time, in one stacked update
+   * @param first, second The measurements at k+1
+   */
+  void UpdateFused(MeasurementPackage & first, MeasurementPackage & second);
+
+  /**
+   * NIS Statistics of the updates with the given measurement dimension,
+   * e.g. NIS(LidarModel::NZ); see nis_
+   */
+  const NISMonitor & NIS(int dimension) const {
+    return nis_[dimension];
+  }
+
+  /**
+   * RecordNIS Adds the NIS of an update to the statistics and, in adaptive mode,
+   * tunes the process noise
+   * @param nis NIS of the update
+   * @param dimension Dimension of the measurement
+   */
+  void RecordNIS(double nis, int dimension);
+
+  /**
+   * LidarNoise, RadarNoise Measurement noise covariance matrices
+   */
+  LidarModel::MeasMatrix LidarNoise() const;
+  RadarModel::MeasMatrix RadarNoise() const;
 };
 
 #endif /* UKF_H */
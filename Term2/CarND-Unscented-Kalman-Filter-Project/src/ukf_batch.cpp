@@ -0,0 +1,562 @@
+#include "ukf_batch.h"
+#include "fast_math.h"
+#include "trace.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Copies one row of a block; a constant length lets the compiler inline it as vector moves
+inline void CopyRow(const double* from, double* to) {
+  for (int l = 0; l < UKFBatch::BLOCK; l++) {
+    to[l] = from[l];
+  }
+}
+
+// out[l] = init + sum over sigma points sp of w[sp] a[sp][l] b[sp][l]
+inline void WeightedSum(const double* w, const double (*a)[UKFBatch::BLOCK], const double (*b)[UKFBatch::BLOCK],
+                        double init, double* out) {
+  for (int l = 0; l < UKFBatch::BLOCK; l++) {
+    out[l] = init;
+  }
+  for (int sp = 0; sp < UKFBatch::NSIG; sp++) {
+    for (int l = 0; l < UKFBatch::BLOCK; l++) {
+      out[l] += w[sp] * a[sp][l] * b[sp][l];
+    }
+  }
+}
+
+// Wraps an angle to [-pi, pi] without a loop, so it vectorizes
+inline double WrapAngle(double angle) {
+  return angle - 2.*M_PI * round_nearest(angle * (0.5 / M_PI));
+}
+
+// Lane-wise measurement models; zsig is indexed [component * NSIG + sigma point][lane]
+struct LidarLanes {
+  enum { NZ = 2, ANGLE = -1 };
+
+  static void Read(const UKFBatch::LidarMeasurement& m, double* z) {
+    z[0] = m.px;
+    z[1] = m.py;
+  }
+
+  static void Transform(const double (*sig)[UKFBatch::BLOCK], double (*zsig)[UKFBatch::BLOCK], int len) {
+    const int NSIG = UKFBatch::NSIG;
+    for (int s = 0; s < NSIG; s++) {
+      for (int l = 0; l < len; l++) {
+        zsig[s][l] = sig[s][l];                //px
+        zsig[NSIG + s][l] = sig[NSIG + s][l];  //py
+      }
+    }
+  }
+};
+
+struct RadarLanes {
+  enum { NZ = 3, ANGLE = 1 };
+
+  static void Read(const UKFBatch::RadarMeasurement& m, double* z) {
+    z[0] = m.rho;
+    z[1] = m.phi;
+    z[2] = m.rho_dot;
+  }
+
+  static void Transform(const double (*sig)[UKFBatch::BLOCK], double (*zsig)[UKFBatch::BLOCK], int len) {
+    const int NSIG = UKFBatch::NSIG;
+    for (int s = 0; s < NSIG; s++) {
+      for (int l = 0; l < len; l++) {
+        double p_x = sig[s][l];
+        double p_y = sig[NSIG + s][l];
+        double v   = sig[2 * NSIG + s][l];
+        double yaw = sig[3 * NSIG + s][l];
+
+        double sin_yaw, cos_yaw;
+        sincos_poly(yaw, sin_yaw, cos_yaw);
+        double r = sqrt(p_x*p_x + p_y*p_y);
+        zsig[s][l] = r;                                            //r
+        zsig[NSIG + s][l] = atan2_poly(p_y, p_x);                  //phi
+        zsig[2 * NSIG + s][l] = (p_x*cos_yaw + p_y*sin_yaw)*v / r; //r_dot
+      }
+    }
+  }
+};
+
+}
+
+UKFBatch::UKFBatch(int num_threads)
+    : pool_(max(1, num_threads)), scratch_(new Scratch[max(1, num_threads)]),
+      num_tracks_(0), capacity_(0) {
+
+  // same noise as UKF
+  std_a_ = 2;
+  std_yawdd_ = 1;
+  std_laspx_ = 0.15;
+  std_laspy_ = 0.15;
+  std_radr_ = 0.3;
+  std_radphi_ = 0.03;
+  std_radrd_ = 0.3;
+
+  double lambda = 3 - NAUG;
+  weights_[0] = lambda / (lambda + NAUG);
+  for (int i = 1; i < NSIG; i++) {
+    weights_[i] = 0.5 / (lambda + NAUG);
+  }
+  spread_ = sqrt(lambda + NAUG);
+
+  Reserve(BLOCK);
+}
+
+void UKFBatch::Reserve(int capacity) {
+  if (capacity <= capacity_) {
+    return;
+  }
+  // repack every component row with the new stride
+  capacity = (capacity + BLOCK - 1) / BLOCK * BLOCK;
+  vector<double> x(NX * capacity), P(NX * NX * capacity), sig(NX * NSIG * capacity);
+  for (int k = 0; k < NX; k++) {
+    copy(x_.begin() + k * capacity_, x_.begin() + k * capacity_ + num_tracks_, x.begin() + k * capacity);
+  }
+  for (int k = 0; k < NX * NX; k++) {
+    copy(P_.begin() + k * capacity_, P_.begin() + k * capacity_ + num_tracks_, P.begin() + k * capacity);
+  }
+  for (int k = 0; k < NX * NSIG; k++) {
+    copy(sig_.begin() + k * capacity_, sig_.begin() + k * capacity_ + num_tracks_, sig.begin() + k * capacity);
+  }
+  x_.swap(x);
+  P_.swap(P);
+  sig_.swap(sig);
+  capacity_ = capacity;
+  for (int t = num_tracks_; t < capacity_; t++) {
+    ResetPadding(t);
+  }
+}
+
+void UKFBatch::ResetPadding(int track) {
+  for (int k = 0; k < NX * NX; k++) {
+    P_[k * capacity_ + track] = k % (NX + 1) == 0 ? 1.0 : 0.0;
+  }
+}
+
+int UKFBatch::AddTrack(const StateVector& x, const StateMatrix& P) {
+  if (num_tracks_ == capacity_) {
+    Reserve(2 * capacity_);
+  }
+  int t = num_tracks_++;
+  for (int k = 0; k < NX; k++) {
+    x_[k * capacity_ + t] = x(k);
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j < NX; j++) {
+      P_[(i * NX + j) * capacity_ + t] = P(i, j);
+    }
+  }
+  for (int k = 0; k < NX * NSIG; k++) {
+    sig_[k * capacity_ + t] = x(k / NSIG);
+  }
+  return t;
+}
+
+void UKFBatch::RemoveTrack(int track) {
+  int last = --num_tracks_;
+  for (int k = 0; k < NX; k++) {
+    x_[k * capacity_ + track] = x_[k * capacity_ + last];
+  }
+  for (int k = 0; k < NX * NX; k++) {
+    P_[k * capacity_ + track] = P_[k * capacity_ + last];
+  }
+  for (int k = 0; k < NX * NSIG; k++) {
+    sig_[k * capacity_ + track] = sig_[k * capacity_ + last];
+  }
+  ResetPadding(last);
+}
+
+void UKFBatch::GetTrack(int track, StateVector& x, StateMatrix& P) const {
+  for (int k = 0; k < NX; k++) {
+    x(k) = x_[k * capacity_ + track];
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j < NX; j++) {
+      P(i, j) = P_[(i * NX + j) * capacity_ + track];
+    }
+  }
+}
+
+void UKFBatch::Predict(const vector<double>& delta_t) {
+  TRACE_SCOPE("batch.predict");
+  int num_blocks = (num_tracks_ + BLOCK - 1) / BLOCK;
+  pool_.parallelFor(num_blocks, [this, &delta_t](int begin, int end, int worker) {
+    for (int b = begin; b < end; b++) {
+      PredictBlock(b * BLOCK, min(num_tracks_, (b + 1) * BLOCK), delta_t.data(), scratch_[worker]);
+    }
+  });
+}
+
+void UKFBatch::PredictBlock(int begin, int end, const double* delta_t, Scratch& s) {
+  // every kernel runs on the whole block: a constant trip count unrolls without remainder
+  // loops, and the padding tracks past num_tracks_ hold a harmless identity covariance
+  const int len = BLOCK;
+  const int cap = capacity_;
+
+  /*****************************************************************************
+   *  Square root of P, scaled by the spread
+   ****************************************************************************/
+  for (int j = 0; j < NX; j++) {
+    for (int i = j; i < NX; i++) {
+      double* Lij = s.L[i * NX + j];
+      const double* Pij = &P_[(i * NX + j) * cap + begin];
+      for (int l = 0; l < len; l++) {
+        Lij[l] = Pij[l];
+      }
+      for (int k = 0; k < j; k++) {
+        const double* Lik = s.L[i * NX + k];
+        const double* Ljk = s.L[j * NX + k];
+        for (int l = 0; l < len; l++) {
+          Lij[l] -= Lik[l] * Ljk[l];
+        }
+      }
+      const double* Ljj = s.L[j * NX + j];
+      if (i == j) {
+        for (int l = 0; l < len; l++) {
+          Lij[l] = sqrt(Lij[l]);
+        }
+      } else {
+        for (int l = 0; l < len; l++) {
+          Lij[l] /= Ljj[l];
+        }
+      }
+    }
+  }
+  for (int j = 0; j < NX; j++) {
+    for (int i = j; i < NX; i++) {
+      for (int l = 0; l < len; l++) {
+        s.L[i * NX + j][l] *= spread_;
+      }
+    }
+  }
+
+  /*****************************************************************************
+   *  Generate and predict sigma points
+   ****************************************************************************/
+  for (int l = 0; l < len; l++) {
+    s.dt[l] = begin + l < end ? delta_t[begin + l] : 0.0;
+  }
+  for (int sp = 0; sp < NSIG; sp++) {
+    // sigma point sp moves the mean along column a of the augmented square root
+    int a = sp == 0 ? -1 : (sp - 1) % NAUG;
+    double sign = sp <= NAUG ? 1.0 : -1.0;
+
+    for (int k = 0; k < NX; k++) {
+      const double* xk = &x_[k * cap + begin];
+      if (a >= 0 && a <= k) {
+        const double* Lka = s.L[k * NX + a];
+        for (int l = 0; l < len; l++) {
+          s.x[k][l] = xk[l] + sign * Lka[l];
+        }
+      } else {
+        for (int l = 0; l < len; l++) {
+          s.x[k][l] = xk[l];
+        }
+      }
+    }
+    // the noise block of P_aug is diagonal, so the noise values are the same for all tracks
+    double nu_a = a == NX ? sign * spread_ * std_a_ : 0.0;
+    double nu_yawdd = a == NX + 1 ? sign * spread_ * std_yawdd_ : 0.0;
+
+    // written to the scratch rather than sig_: fields of one struct never alias, so the
+    // compiler vectorizes this loop without runtime overlap checks
+    for (int l = 0; l < len; l++) {
+      double p_x = s.x[0][l];
+      double p_y = s.x[1][l];
+      double v = s.x[2][l];
+      double yaw = s.x[3][l];
+      double yawd = s.x[4][l];
+      double dt = s.dt[l];
+
+      double sin_yaw, cos_yaw, sin_yaw_p, cos_yaw_p;
+      sincos_poly(yaw, sin_yaw, cos_yaw);
+      sincos_poly(yaw + yawd*dt, sin_yaw_p, cos_yaw_p);
+
+      //avoid division by zero
+      bool turning = fabs(yawd) > 0.001;
+      double px_p = turning ? p_x + v/yawd * (sin_yaw_p - sin_yaw) : p_x + v*dt*cos_yaw;
+      double py_p = turning ? p_y + v/yawd * (cos_yaw - cos_yaw_p) : p_y + v*dt*sin_yaw;
+
+      //add noise
+      s.sig[0 * NSIG + sp][l] = px_p + 0.5*nu_a*dt*dt * cos_yaw;
+      s.sig[1 * NSIG + sp][l] = py_p + 0.5*nu_a*dt*dt * sin_yaw;
+      s.sig[2 * NSIG + sp][l] = v + nu_a*dt;
+      s.sig[3 * NSIG + sp][l] = yaw + yawd*dt + 0.5*nu_yawdd*dt*dt;
+      s.sig[4 * NSIG + sp][l] = yawd + nu_yawdd*dt;
+    }
+  }
+
+  for (int k = 0; k < NX * NSIG; k++) {
+    CopyRow(s.sig[k], &sig_[k * cap + begin]);
+  }
+
+  /*****************************************************************************
+   *  Predict mean and covariance
+   ****************************************************************************/
+  for (int k = 0; k < NX; k++) {
+    for (int l = 0; l < len; l++) {
+      s.x[k][l] = 0.0;
+    }
+    for (int sp = 0; sp < NSIG; sp++) {
+      for (int l = 0; l < len; l++) {
+        s.x[k][l] += weights_[sp] * s.sig[k * NSIG + sp][l];
+      }
+    }
+  }
+
+  // residuals overwrite the sigma points, which are already stored
+  for (int k = 0; k < NX; k++) {
+    for (int sp = 0; sp < NSIG; sp++) {
+      double* xd = s.sig[k * NSIG + sp];
+      for (int l = 0; l < len; l++) {
+        xd[l] = k == 3 ? WrapAngle(xd[l] - s.x[k][l]) : xd[l] - s.x[k][l];
+      }
+    }
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j <= i; j++) {
+      WeightedSum(weights_, s.sig + i * NSIG, s.sig + j * NSIG, 0.0, s.P[i * NX + j]);
+    }
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j < i; j++) {
+      for (int l = 0; l < len; l++) {
+        s.P[j * NX + i][l] = s.P[i * NX + j][l];
+      }
+    }
+  }
+  for (int l = 0; l < len; l++) {
+    s.x[3][l] = WrapAngle(s.x[3][l]);
+  }
+
+  for (int k = 0; k < NX; k++) {
+    CopyRow(s.x[k], &x_[k * cap + begin]);
+  }
+  for (int k = 0; k < NX * NX; k++) {
+    CopyRow(s.P[k], &P_[k * cap + begin]);
+  }
+}
+
+void UKFBatch::UpdateLidar(const vector<LidarMeasurement>& measurements) {
+  TRACE_SCOPE("batch.update_lidar");
+  double R[2] = { std_laspx_*std_laspx_, std_laspy_*std_laspy_ };
+  Update<LidarLanes>(measurements, R);
+}
+
+void UKFBatch::UpdateRadar(const vector<RadarMeasurement>& measurements) {
+  TRACE_SCOPE("batch.update_radar");
+  double R[3] = { std_radr_*std_radr_, std_radphi_*std_radphi_, std_radrd_*std_radrd_ };
+  Update<RadarLanes>(measurements, R);
+}
+
+template <class Model, class Measurement>
+void UKFBatch::Update(const vector<Measurement>& measurements, const double* R) {
+  int count = (int)measurements.size();
+  int num_blocks = (count + BLOCK - 1) / BLOCK;
+  pool_.parallelFor(num_blocks, [this, &measurements, count, R](int begin, int end, int worker) {
+    for (int b = begin; b < end; b++) {
+      UpdateBlock<Model>(&measurements[b * BLOCK], min((int)BLOCK, count - b * BLOCK), R, scratch_[worker]);
+    }
+  });
+}
+
+template <class Model, class Measurement>
+void UKFBatch::UpdateBlock(const Measurement* measurements, int count, const double* R, Scratch& s) {
+  enum { NZ = Model::NZ };
+  const int len = BLOCK;
+  const int cap = capacity_;
+
+  // measurements of consecutive tracks (the usual case when a sensor sees every track)
+  // are copied row by row instead of gathered lane by lane
+  int first = measurements[0].track;
+  bool consecutive = count == len;
+  for (int l = 1; l < count && consecutive; l++) {
+    consecutive = measurements[l].track == first + l;
+  }
+
+  for (int l = 0; l < len; l++) {
+    // unused lanes repeat the first measurement and are not written back
+    double z[NZ];
+    Model::Read(measurements[l < count ? l : 0], z);
+    for (int m = 0; m < NZ; m++) {
+      s.z[m][l] = z[m];
+    }
+  }
+  if (consecutive) {
+    for (int k = 0; k < NX; k++) {
+      CopyRow(&x_[k * cap + first], s.x[k]);
+    }
+    for (int k = 0; k < NX * NX; k++) {
+      CopyRow(&P_[k * cap + first], s.P[k]);
+    }
+    for (int k = 0; k < NX * NSIG; k++) {
+      CopyRow(&sig_[k * cap + first], s.sig[k]);
+    }
+  } else {
+    for (int l = 0; l < len; l++) {
+      int t = measurements[l < count ? l : 0].track;
+      for (int k = 0; k < NX; k++) {
+        s.x[k][l] = x_[k * cap + t];
+      }
+      for (int k = 0; k < NX * NX; k++) {
+        s.P[k][l] = P_[k * cap + t];
+      }
+      for (int k = 0; k < NX * NSIG; k++) {
+        s.sig[k][l] = sig_[k * cap + t];
+      }
+    }
+  }
+
+  /*****************************************************************************
+   *  Predict measurement mean and residuals
+   ****************************************************************************/
+  Model::Transform(s.sig, s.zsig, len);
+
+  double (*z_pred)[BLOCK] = s.z_pred;
+  for (int m = 0; m < NZ; m++) {
+    for (int l = 0; l < len; l++) {
+      z_pred[m][l] = 0.0;
+    }
+    for (int sp = 0; sp < NSIG; sp++) {
+      for (int l = 0; l < len; l++) {
+        z_pred[m][l] += weights_[sp] * s.zsig[m * NSIG + sp][l];
+      }
+    }
+  }
+
+  // residuals overwrite the sigma points
+  for (int m = 0; m < NZ; m++) {
+    for (int sp = 0; sp < NSIG; sp++) {
+      double* zd = s.zsig[m * NSIG + sp];
+      for (int l = 0; l < len; l++) {
+        zd[l] = m == Model::ANGLE ? WrapAngle(zd[l] - z_pred[m][l]) : zd[l] - z_pred[m][l];
+      }
+    }
+  }
+  for (int k = 0; k < NX; k++) {
+    for (int sp = 0; sp < NSIG; sp++) {
+      double* xd = s.sig[k * NSIG + sp];
+      for (int l = 0; l < len; l++) {
+        xd[l] = k == 3 ? WrapAngle(xd[l] - s.x[k][l]) : xd[l] - s.x[k][l];
+      }
+    }
+  }
+
+  /*****************************************************************************
+   *  Innovation covariance S and cross correlation Tc
+   ****************************************************************************/
+  double (*S)[BLOCK] = s.S;    // lower triangle, [i * NZ + j]
+  double (*Tc)[BLOCK] = s.Tc;  // [k * NZ + m]
+  for (int i = 0; i < NZ; i++) {
+    for (int j = 0; j <= i; j++) {
+      WeightedSum(weights_, s.zsig + i * NSIG, s.zsig + j * NSIG, i == j ? R[i] : 0.0, S[i * NZ + j]);
+    }
+  }
+  for (int k = 0; k < NX; k++) {
+    for (int m = 0; m < NZ; m++) {
+      WeightedSum(weights_, s.sig + k * NSIG, s.zsig + m * NSIG, 0.0, Tc[k * NZ + m]);
+    }
+  }
+
+  /*****************************************************************************
+   *  Kalman gain K = Tc S^-1 from a Cholesky factor of S, no explicit inverse
+   ****************************************************************************/
+  for (int j = 0; j < NZ; j++) {
+    for (int i = j; i < NZ; i++) {
+      double* Sij = S[i * NZ + j];
+      for (int k = 0; k < j; k++) {
+        for (int l = 0; l < len; l++) {
+          Sij[l] -= S[i * NZ + k][l] * S[j * NZ + k][l];
+        }
+      }
+      for (int l = 0; l < len; l++) {
+        Sij[l] = i == j ? sqrt(Sij[l]) : Sij[l] / S[j * NZ + j][l];
+      }
+    }
+  }
+  double (*K)[BLOCK] = s.K;    // [k * NZ + m]
+  for (int k = 0; k < NX; k++) {
+    double* Kk[NZ];
+    for (int m = 0; m < NZ; m++) {
+      Kk[m] = K[k * NZ + m];
+    }
+    // forward substitution with L, then back substitution with L^T
+    for (int i = 0; i < NZ; i++) {
+      for (int l = 0; l < len; l++) {
+        Kk[i][l] = Tc[k * NZ + i][l];
+      }
+      for (int j = 0; j < i; j++) {
+        for (int l = 0; l < len; l++) {
+          Kk[i][l] -= S[i * NZ + j][l] * Kk[j][l];
+        }
+      }
+      for (int l = 0; l < len; l++) {
+        Kk[i][l] /= S[i * NZ + i][l];
+      }
+    }
+    for (int i = NZ - 1; i >= 0; i--) {
+      for (int j = i + 1; j < NZ; j++) {
+        for (int l = 0; l < len; l++) {
+          Kk[i][l] -= S[j * NZ + i][l] * Kk[j][l];
+        }
+      }
+      for (int l = 0; l < len; l++) {
+        Kk[i][l] /= S[i * NZ + i][l];
+      }
+    }
+  }
+
+  /*****************************************************************************
+   *  Update state: x += K (z - z_pred), P -= K S K^T = K Tc^T
+   ****************************************************************************/
+  for (int m = 0; m < NZ; m++) {
+    for (int l = 0; l < len; l++) {
+      double d = s.z[m][l] - z_pred[m][l];
+      s.z[m][l] = m == Model::ANGLE ? WrapAngle(d) : d;
+    }
+  }
+  for (int k = 0; k < NX; k++) {
+    for (int m = 0; m < NZ; m++) {
+      for (int l = 0; l < len; l++) {
+        s.x[k][l] += K[k * NZ + m][l] * s.z[m][l];
+      }
+    }
+  }
+  for (int i = 0; i < NX; i++) {
+    for (int j = 0; j <= i; j++) {
+      double* Pij = s.P[i * NX + j];
+      for (int m = 0; m < NZ; m++) {
+        for (int l = 0; l < len; l++) {
+          Pij[l] -= K[i * NZ + m][l] * Tc[j * NZ + m][l];
+        }
+      }
+      for (int l = 0; l < len; l++) {
+        s.P[j * NX + i][l] = Pij[l];
+      }
+    }
+  }
+
+  // scatter back
+  if (consecutive) {
+    for (int k = 0; k < NX; k++) {
+      CopyRow(s.x[k], &x_[k * cap + first]);
+    }
+    for (int k = 0; k < NX * NX; k++) {
+      CopyRow(s.P[k], &P_[k * cap + first]);
+    }
+    return;
+  }
+  for (int l = 0; l < count; l++) {
+    int t = measurements[l].track;
+    for (int k = 0; k < NX; k++) {
+      x_[k * cap + t] = s.x[k][l];
+    }
+    for (int k = 0; k < NX * NX; k++) {
+      P_[k * cap + t] = s.P[k][l];
+    }
+  }
+}
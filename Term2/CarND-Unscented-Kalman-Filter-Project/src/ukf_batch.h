@@ -0,0 +1,138 @@
+#ifndef UKF_BATCH_H
+#define UKF_BATCH_H
+
+#include "ukf_core.h"
+#include "thread_pool.h"
+#include <memory>
+#include <vector>
+
+/**
+ * CTRV unscented Kalman filter for many tracks at once.
+ *
+ * States, covariances and predicted sigma points of all tracks are stored
+ * structure-of-arrays: component k of track t lives at [k * capacity + t]. The
+ * kernels work on blocks of BLOCK tracks with the track loop innermost, so the
+ * compiler vectorizes across tracks, and the blocks are split across the
+ * worker threads.
+ *
+ * Like UKF, an update uses the sigma points of the track's last Predict, so
+ * every update must follow a prediction of that track.
+ */
+class UKFBatch {
+public:
+
+  enum { NX = CTRVModel::NX, NAUG = CTRVModel::NAUG, NSIG = 2 * NAUG + 1, BLOCK = 32 };
+
+  typedef UKFCore<NX, NAUG>::StateVector StateVector;
+  typedef UKFCore<NX, NAUG>::StateMatrix StateMatrix;
+
+  struct LidarMeasurement {
+    int track;
+    double px, py;
+  };
+
+  struct RadarMeasurement {
+    int track;
+    double rho, phi, rho_dot;
+  };
+
+  ///* Process noise standard deviation longitudinal acceleration in m/s^2
+  double std_a_;
+
+  ///* Process noise standard deviation yaw acceleration in rad/s^2
+  double std_yawdd_;
+
+  ///* Laser measurement noise standard deviation position1/position2 in m
+  double std_laspx_;
+  double std_laspy_;
+
+  ///* Radar measurement noise standard deviation radius in m, angle in rad, radius change in m/s
+  double std_radr_;
+  double std_radphi_;
+  double std_radrd_;
+
+  /**
+   * Constructor
+   * @param num_threads Number of threads running the kernels, including the caller
+   */
+  explicit UKFBatch(int num_threads = 1);
+
+  /**
+   * AddTrack Starts a track and returns its index
+   */
+  int AddTrack(const StateVector& x, const StateMatrix& P);
+
+  /**
+   * RemoveTrack Drops a track; the last track moves into its index
+   */
+  void RemoveTrack(int track);
+
+  int NumTracks() const {
+    return num_tracks_;
+  }
+
+  /**
+   * GetTrack Copies the state and covariance of a track
+   */
+  void GetTrack(int track, StateVector& x, StateMatrix& P) const;
+
+  /**
+   * Predict Predicts sigma points, state and covariance of all tracks
+   * @param delta_t Time since the last measurement of each track in s, one per track
+   */
+  void Predict(const std::vector<double>& delta_t);
+
+  /**
+   * UpdateLidar Applies laser measurements, at most one per track
+   */
+  void UpdateLidar(const std::vector<LidarMeasurement>& measurements);
+
+  /**
+   * UpdateRadar Applies radar measurements, at most one per track
+   */
+  void UpdateRadar(const std::vector<RadarMeasurement>& measurements);
+
+private:
+
+  // Per-worker temporaries for one block of tracks, indexed [component][lane]
+  struct Scratch {
+    double x[NX][BLOCK];
+    double P[NX * NX][BLOCK];
+    double L[NX * NX][BLOCK];
+    double sig[NX * NSIG][BLOCK];
+    double zsig[3 * NSIG][BLOCK];
+    double z[3][BLOCK];
+    double z_pred[3][BLOCK];
+    double S[3 * 3][BLOCK];
+    double Tc[NX * 3][BLOCK];
+    double K[NX * 3][BLOCK];
+    double dt[BLOCK];
+  };
+
+  ThreadPool pool_;
+  std::unique_ptr<Scratch[]> scratch_;
+
+  double weights_[NSIG];
+  double spread_;  // sqrt(lambda + n_aug)
+
+  int num_tracks_;
+  int capacity_;
+  std::vector<double> x_;    // [NX][capacity_]
+  std::vector<double> P_;    // [NX * NX][capacity_]
+  std::vector<double> sig_;  // [NX * NSIG][capacity_], predicted sigma points
+
+  void Reserve(int capacity);
+
+  // Unused slots past num_tracks_ take part in the block kernels with an identity covariance
+  void ResetPadding(int track);
+
+  void PredictBlock(int begin, int end, const double* delta_t, Scratch& s);
+
+  template <class Model, class Measurement>
+  void UpdateBlock(const Measurement* measurements, int count, const double* R, Scratch& s);
+
+  template <class Model, class Measurement>
+  void Update(const std::vector<Measurement>& measurements, const double* R);
+};
+
+#endif /* UKF_BATCH_H */
@@ -0,0 +1,620 @@
+#ifndef UKF_CORE_H
+#define UKF_CORE_H
+
+#include "Eigen/Dense"
+#include <math.h>
+
+/**
+ * Wraps an angle to [-pi, pi]
+ */
+inline double NormalizeAngle(double angle) {
+  while (angle > M_PI) angle -= 2.*M_PI;
+  while (angle < -M_PI) angle += 2.*M_PI;
+  return angle;
+}
+
+/**
+ * CholeskyUpdate Turns the lower Cholesky factor L of A into the factor of
+ *   A + sign * v * v^T (rank-1 update for sign > 0, downdate for sign < 0)
+ * @return false, leaving L unchanged, if a downdate would make A indefinite
+ *   or L is singular
+ */
+template <int N>
+bool CholeskyUpdate(Eigen::Matrix<double, N, N>& L, Eigen::Matrix<double, N, 1> v, double sign) {
+  Eigen::Matrix<double, N, N> L_new = L;
+  for (int k = 0; k < N; k++) {
+    double r2 = L_new(k, k)*L_new(k, k) + sign*v(k)*v(k);
+    if (!(r2 > 0) || L_new(k, k) == 0) {
+      return false;
+    }
+    double r = sqrt(r2);
+    double l_inv = 1 / L_new(k, k);
+    double c = r * l_inv;
+    double c_inv = L_new(k, k) / r;
+    double s = v(k) * l_inv;
+    L_new(k, k) = r;
+    for (int i = k + 1; i < N; i++) {
+      L_new(i, k) = (L_new(i, k) + sign*s*v(i)) * c_inv;
+      v(i) = c*v(i) - s*L_new(i, k);
+    }
+  }
+  L = L_new;
+  return true;
+}
+
+/**
+ * CholeskyDowndate Turns the lower Cholesky factor L of A into the factor of
+ *   A - V * V^T, the M rank-1 downdates with the columns of V in one sweep: each
+ *   column of L is combined with the rows of V by one hyperbolic Householder
+ *   reflection, so it takes one square root per column of L instead of M
+ * @return false, leaving L unchanged, if A - V * V^T is not positive definite
+ */
+template <int N, int M>
+bool CholeskyDowndate(Eigen::Matrix<double, N, N>& L, Eigen::Matrix<double, N, M> V) {
+  Eigen::Matrix<double, N, N> L_new = L;
+  for (int k = 0; k < N; k++) {
+    double alpha = L_new(k, k);
+    double w2 = V.row(k).squaredNorm();
+    double sigma2 = alpha*alpha - w2;
+    if (!(sigma2 > 0) || !(alpha > 0)) {
+      return false;
+    }
+    if (w2 == 0) {
+      continue;
+    }
+    //reflect [alpha w] onto [sigma 0] with u = [alpha - sigma  w], alpha - sigma
+    //written as w2 / (alpha + sigma) to avoid cancellation
+    double sigma = sqrt(sigma2);
+    double u0 = w2 / (alpha + sigma);
+    double f_scale = 1 / (sigma * u0);
+    for (int i = k + 1; i < N; i++) {
+      double f = (V.row(i).dot(V.row(k)) - L_new(i, k)*u0) * f_scale;
+      L_new(i, k) -= f*u0;
+      V.row(i) -= f*V.row(k);
+    }
+    L_new(k, k) = sigma;
+  }
+  L = L_new;
+  return true;
+}
+
+/**
+ * CholeskyFactor Lower Cholesky factor L of a small symmetric matrix A,
+ *   reading only the lower triangle of A
+ * @return false if A is not positive definite
+ */
+template <int N>
+bool CholeskyFactor(const Eigen::Matrix<double, N, N>& A, Eigen::Matrix<double, N, N>& L) {
+  L.setZero();
+  for (int j = 0; j < N; j++) {
+    double d = A(j, j);
+    for (int k = 0; k < j; k++) {
+      d -= L(j, k)*L(j, k);
+    }
+    if (!(d > 0)) {
+      return false;
+    }
+    L(j, j) = sqrt(d);
+    double l_inv = 1 / L(j, j);
+    for (int i = j + 1; i < N; i++) {
+      double a = A(i, j);
+      for (int k = 0; k < j; k++) {
+        a -= L(i, k)*L(j, k);
+      }
+      L(i, j) = a * l_inv;
+    }
+  }
+  return true;
+}
+
+/**
+ * LowerFactorFromQR Lower-triangular factor L with L * L^T = A^T * A, i.e. the
+ *   transposed R of the QR decomposition of A, with a positive diagonal.
+ *   Householder reflections that only form R, on a copy of A
+ */
+template <int ROWS, int N>
+void LowerFactorFromQR(Eigen::Matrix<double, ROWS, N> A, Eigen::Matrix<double, N, N>& L) {
+  for (int k = 0; k < N; k++) {
+    //reflect column k onto alpha e_k with the Householder vector v = a - alpha e_k
+    double norm2 = 0;
+    for (int i = k; i < ROWS; i++) {
+      norm2 += A(i, k)*A(i, k);
+    }
+    double alpha = A(k, k) < 0 ? sqrt(norm2) : -sqrt(norm2);
+    double v_k = A(k, k) - alpha;
+    double vv = norm2 - A(k, k)*A(k, k) + v_k*v_k;
+    A(k, k) = alpha;
+    if (vv == 0) {
+      continue;
+    }
+    for (int j = k + 1; j < N; j++) {
+      double dot = v_k*A(k, j);
+      for (int i = k + 1; i < ROWS; i++) {
+        dot += A(i, k)*A(i, j);
+      }
+      double f = 2*dot / vv;
+      A(k, j) -= f*v_k;
+      for (int i = k + 1; i < ROWS; i++) {
+        A(i, j) -= f*A(i, k);
+      }
+    }
+  }
+  for (int k = 0; k < N; k++) {
+    double sign = A(k, k) < 0 ? -1 : 1;
+    for (int i = 0; i < N; i++) {
+      L(i, k) = i < k ? 0 : sign*A(k, i);
+    }
+  }
+}
+
+/**
+ * Unscented Kalman filter arithmetic on fixed-size Eigen types.
+ *
+ * NX is the state dimension and NAUG the state dimension augmented with the
+ * process noise. The process and measurement models are template arguments of
+ * Predict and Update, so every matrix has a compile-time size: nothing is
+ * allocated on the heap and Eigen can unroll the sigma-point loops.
+ *
+ * A process model provides
+ *   void Propagate(const AugVector& x_aug, double delta_t, StateVector& x_pred) const;
+ * and a measurement model provides
+ *   enum { NZ = ... };  typedef Eigen::Matrix<double, NZ, 1> MeasVector;  MeasMatrix likewise
+ *   void Transform(const StateVector& x, MeasVector& z) const;
+ *   void NormalizeResidual(MeasVector& z_diff) const;
+ *
+ * In square-root mode (square_root_) the filter propagates the lower Cholesky
+ * factor S_ of the covariance instead of P_ itself: the sigma points come from
+ * S_ directly, the predicted factor is computed with a QR decomposition of the
+ * weighted residuals and a rank-1 Cholesky downdate, and the update downdates
+ * the factor with the gain times the square root of the innovation covariance.
+ * The covariance stays positive definite by construction, so long runs cannot fail in llt() on a P_ that
+ * rounding has made indefinite. P_ = S_ * S_^T is still kept up to date for
+ * readers, but it must be set with SetCovariance.
+ */
+template <int NX, int NAUG>
+class UKFCore {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  enum { NSIG = 2 * NAUG + 1, NNOISE = NAUG - NX };
+
+  typedef Eigen::Matrix<double, NX, 1> StateVector;
+  typedef Eigen::Matrix<double, NX, NX> StateMatrix;
+  typedef Eigen::Matrix<double, NAUG, 1> AugVector;
+  typedef Eigen::Matrix<double, NAUG, NAUG> AugMatrix;
+  typedef Eigen::Matrix<double, NNOISE, 1> NoiseVector;
+  typedef Eigen::Matrix<double, NX, NSIG> SigmaMatrix;
+  typedef Eigen::Matrix<double, NAUG, NSIG> AugSigmaMatrix;
+  typedef Eigen::Matrix<double, NSIG, 1> WeightVector;
+
+  ///* state vector
+  StateVector x_;
+
+  ///* state covariance matrix
+  StateMatrix P_;
+
+  ///* lower Cholesky factor of P_, propagated instead of P_ in square-root mode
+  StateMatrix S_;
+
+  ///* if this is true, Predict and Update run the square-root filter
+  bool square_root_;
+
+  ///* predicted sigma points matrix
+  SigmaMatrix Xsig_pred_;
+
+  ///* Weights of sigma points
+  WeightVector weights_;
+
+  ///* Sigma point spreading parameter
+  double lambda_;
+
+  ///* Index of the state component that is an angle, -1 if none
+  int yaw_index_;
+
+  ///* log-likelihood of the measurement of the last Update under the predicted
+  ///* measurement distribution N(z_pred, S), NaN if the update was rejected
+  double log_likelihood_;
+
+  /**
+   * Constructor
+   * @param yaw_index State component that is wrapped to [-pi, pi] in residuals
+   */
+  explicit UKFCore(int yaw_index = -1)
+      : square_root_(false), lambda_(3 - NAUG), yaw_index_(yaw_index), log_likelihood_(NAN) {
+    x_.setZero();
+    P_.setIdentity();
+    S_.setIdentity();
+    Xsig_pred_.setZero();
+    SetLambda(lambda_);
+  }
+
+  /**
+   * SetLambda Sets the spreading parameter and the sigma point weights
+   */
+  void SetLambda(double lambda) {
+    lambda_ = lambda;
+    weights_.setConstant(0.5 / (lambda_ + NAUG));
+    weights_(0) = lambda_ / (lambda_ + NAUG);
+  }
+
+  /**
+   * SetCovariance Sets P_ and its Cholesky factor S_
+   */
+  void SetCovariance(const StateMatrix& P) {
+    P_ = P;
+    S_ = P.llt().matrixL();
+  }
+
+  /**
+   * Predict Predicts sigma points, the state, and the state covariance matrix
+   * @param delta_t Time between k and k+1 in s
+   * @param noise_std Standard deviations of the process noise components
+   */
+  template <class Process>
+  void Predict(double delta_t, const NoiseVector& noise_std, const Process& process) {
+
+    //create augmented mean state, the noise has zero mean
+    AugVector x_aug;
+    x_aug.template head<NX>() = x_;
+    x_aug.template tail<NNOISE>().setZero();
+
+    //create square root of the augmented covariance matrix; the noise is independent of the state,
+    //so in square-root mode it is block diagonal in S_ and the noise deviations
+    AugMatrix L;
+    if (square_root_) {
+      L.setZero();
+      L.template topLeftCorner<NX, NX>() = S_;
+      L.template bottomRightCorner<NNOISE, NNOISE>().diagonal() = noise_std;
+    } else {
+      AugMatrix P_aug;
+      P_aug.setZero();
+      P_aug.template topLeftCorner<NX, NX>() = P_;
+      P_aug.template bottomRightCorner<NNOISE, NNOISE>().diagonal() = noise_std.cwiseProduct(noise_std);
+      L = P_aug.llt().matrixL();
+    }
+    L *= sqrt(lambda_ + NAUG);
+
+    //create augmented sigma points
+    AugSigmaMatrix Xsig_aug;
+    Xsig_aug.col(0) = x_aug;
+    Xsig_aug.template middleCols<NAUG>(1) = L.colwise() + x_aug;
+    Xsig_aug.template rightCols<NAUG>() = (-L).colwise() + x_aug;
+
+    //predict sigma points
+    for (int i = 0; i < NSIG; i++) {
+      AugVector xa = Xsig_aug.col(i);
+      StateVector xp;
+      process.Propagate(xa, delta_t, xp);
+      Xsig_pred_.col(i) = xp;
+    }
+
+    //predicted state mean and covariance
+    x_ = Xsig_pred_.lazyProduct(weights_);
+    SigmaMatrix Xdiff;
+    StateResiduals(Xdiff);
+    if (square_root_) {
+      SquareRootFactor(Xdiff, S_);
+      P_ = S_.lazyProduct(S_.transpose());
+    } else {
+      P_ = (Xdiff * weights_.asDiagonal()).lazyProduct(Xdiff.transpose());
+    }
+
+    if (yaw_index_ >= 0) {
+      x_(yaw_index_) = NormalizeAngle(x_(yaw_index_));
+    }
+  }
+
+  /**
+   * Update Updates the state and the state covariance matrix from a measurement,
+   *   using the sigma points of the last Predict
+   * @param z The measurement
+   * @param R Measurement noise covariance
+   * @return The normalized innovation squared (NIS) of the measurement,
+   *   NaN if it was rejected because its innovation covariance, or in square-root
+   *   mode the updated covariance, is not positive definite;
+   *   the log-likelihood of the measurement is left in log_likelihood_
+   */
+  template <class Measurement>
+  double Update(const typename Measurement::MeasVector& z, const typename Measurement::MeasMatrix& R,
+              const Measurement& model) {
+    enum { NZ = Measurement::NZ };
+    typedef Eigen::Matrix<double, NZ, NSIG> MeasSigmaMatrix;
+
+    //transform sigma points into measurement space
+    MeasSigmaMatrix Zsig;
+    for (int i = 0; i < NSIG; i++) {
+      StateVector xp = Xsig_pred_.col(i);
+      typename Measurement::MeasVector zp;
+      model.Transform(xp, zp);
+      Zsig.col(i) = zp;
+    }
+
+    //mean predicted measurement
+    typename Measurement::MeasVector z_pred = Zsig.lazyProduct(weights_);
+
+    //residuals of the sigma points
+    MeasSigmaMatrix Zdiff = Zsig.colwise() - z_pred;
+    for (int i = 0; i < NSIG; i++) {
+      typename Measurement::MeasVector zd = Zdiff.col(i);
+      model.NormalizeResidual(zd);
+      Zdiff.col(i) = zd;
+    }
+    SigmaMatrix Xdiff;
+    StateResiduals(Xdiff);
+
+    //residual
+    typename Measurement::MeasVector z_diff = z - z_pred;
+    model.NormalizeResidual(z_diff);
+
+    Eigen::Matrix<double, NSIG, NZ> Zdiff_w = weights_.asDiagonal() * Zdiff.transpose();
+    if (square_root_) {
+      return SquareRootUpdate(z_diff, R, Zdiff, Zdiff_w, Xdiff);
+    }
+
+    //innovation covariance matrix S and cross correlation Tc
+    typename Measurement::MeasMatrix S = Zdiff.lazyProduct(Zdiff_w) + R;
+    Eigen::Matrix<double, NX, NZ> Tc = Xdiff.lazyProduct(Zdiff_w);
+
+    //Kalman gain K;
+    Eigen::Matrix<double, NX, NZ> K;
+    double nis = KalmanGain(Tc, S, z_diff, K);
+    log_likelihood_ = LogLikelihood(nis, log(S.determinant()), NZ);
+
+    //update state mean and covariance matrix
+    x_ += K * z_diff;
+    P_ -= K * S * K.transpose();
+    return nis;
+  }
+
+private:
+
+  // Log of the Gaussian density with NIS nis, log(det S) log_det_S and dimension NZ
+  static double LogLikelihood(double nis, double log_det_S, int NZ) {
+    return -0.5 * (nis + log_det_S + NZ * log(2 * M_PI));
+  }
+
+  /*
+   * Kalman gain K = Tc * S^-1 and NIS z_diff^T * S^-1 * z_diff: the closed-form
+   * inverse for the small S of a single sensor, an LDLT solve for the larger S of
+   * stacked measurements
+   */
+  template <int NZ>
+  static double KalmanGain(const Eigen::Matrix<double, NX, NZ>& Tc, const Eigen::Matrix<double, NZ, NZ>& S,
+                           const Eigen::Matrix<double, NZ, 1>& z_diff, Eigen::Matrix<double, NX, NZ>& K) {
+    if (NZ <= 3) {
+      Eigen::Matrix<double, NZ, NZ> Si = S.inverse();
+      K = Tc * Si;
+      return z_diff.dot(Si * z_diff);
+    }
+    Eigen::LDLT<Eigen::Matrix<double, NZ, NZ> > ldlt(S);
+    K = ldlt.solve(Tc.transpose()).transpose();
+    return z_diff.dot(ldlt.solve(z_diff));
+  }
+
+  /*
+   * Lower Cholesky factor of the weighted sum of outer products of the residuals:
+   * QR of the residuals with the equal weights of sigma points 1..2n, then a rank-1
+   * update or, since lambda < 0 makes the weight of sigma point 0 negative, downdate
+   * with residual 0. A downdate that would make the factor indefinite is skipped,
+   * which keeps a slightly conservative covariance.
+   */
+  void SquareRootFactor(const SigmaMatrix& diff, StateMatrix& factor) const {
+    Eigen::Matrix<double, 2 * NAUG, NX> A = sqrt(weights_(1)) * diff.template rightCols<2 * NAUG>().transpose();
+    LowerFactorFromQR(A, factor);
+    StateVector d0 = sqrt(fabs(weights_(0))) * diff.col(0);
+    CholeskyUpdate(factor, d0, weights_(0) < 0 ? -1 : 1);
+  }
+
+  /*
+   * Square-root measurement update. The small innovation covariance, kept well
+   * conditioned by R, is factored as S = Sz * Sz^T, and the gain is never formed:
+   * with U = Tc * Sz^-T = K * Sz, the state moves by U * (Sz^-1 * z_diff) and
+   * P - K * S * K^T = P - U * U^T is the rank-NZ downdate of S_ with U. If S or the
+   * downdated covariance is not positive definite, the update is rejected as a whole.
+   */
+  template <int NZ>
+  double SquareRootUpdate(const Eigen::Matrix<double, NZ, 1>& z_diff, const Eigen::Matrix<double, NZ, NZ>& R,
+                        const Eigen::Matrix<double, NZ, NSIG>& Zdiff, const Eigen::Matrix<double, NSIG, NZ>& Zdiff_w,
+                        const SigmaMatrix& Xdiff) {
+    typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+
+    //innovation covariance matrix S, its square root and cross correlation Tc
+    MeasMatrix S = Zdiff.lazyProduct(Zdiff_w) + R;
+    MeasMatrix Sz;
+    if (!CholeskyFactor(S, Sz)) {
+      log_likelihood_ = NAN;
+      return NAN;
+    }
+    Eigen::Matrix<double, NX, NZ> U = Xdiff.lazyProduct(Zdiff_w);  //Tc
+
+    //forward substitution with Sz: U = Tc * Sz^-T, e = Sz^-1 * z_diff
+    Eigen::Matrix<double, NZ, 1> e = z_diff;
+    for (int j = 0; j < NZ; j++) {
+      for (int k = 0; k < j; k++) {
+        U.col(j) -= Sz(j, k) * U.col(k);
+        e(j) -= Sz(j, k) * e(k);
+      }
+      U.col(j) /= Sz(j, j);
+      e(j) /= Sz(j, j);
+    }
+
+    //a failed downdate leaves S_ unchanged, and the state is only moved after it
+    if (!CholeskyDowndate(S_, U)) {
+      log_likelihood_ = NAN;
+      return NAN;
+    }
+
+    double nis = e.squaredNorm();
+    log_likelihood_ = LogLikelihood(nis, 2 * Sz.diagonal().array().log().sum(), NZ);
+    x_ += U * e;
+    P_ = S_.lazyProduct(S_.transpose());
+    return nis;
+  }
+
+  // Differences of the predicted sigma points to the state mean
+  void StateResiduals(SigmaMatrix& Xdiff) const {
+    Xdiff = Xsig_pred_.colwise() - x_;
+    if (yaw_index_ >= 0) {
+      for (int i = 0; i < NSIG; i++) {
+        Xdiff(yaw_index_, i) = NormalizeAngle(Xdiff(yaw_index_, i));
+      }
+    }
+  }
+};
+
+/**
+ * Constant turn rate and velocity magnitude process model.
+ * State: [pos1 pos2 vel_abs yaw_angle yaw_rate], noise: [nu_a nu_yawdd]
+ */
+struct CTRVModel {
+  enum { NX = 5, NAUG = 7, YAW = 3 };
+
+  void Propagate(const Eigen::Matrix<double, NAUG, 1>& x_aug, double delta_t,
+                 Eigen::Matrix<double, NX, 1>& x_pred) const {
+    //extract values for better readability
+    double p_x = x_aug(0);
+    double p_y = x_aug(1);
+    double v = x_aug(2);
+    double yaw = x_aug(3);
+    double yawd = x_aug(4);
+    double nu_a = x_aug(5);
+    double nu_yawdd = x_aug(6);
+
+    //predicted state values
+    double px_p, py_p;
+
+    //avoid division by zero
+    if (fabs(yawd) > 0.001) {
+      px_p = p_x + v/yawd * ( sin (yaw + yawd*delta_t) - sin(yaw));
+      py_p = p_y + v/yawd * ( cos(yaw) - cos(yaw+yawd*delta_t) );
+    } else {
+      px_p = p_x + v*delta_t*cos(yaw);
+      py_p = p_y + v*delta_t*sin(yaw);
+    }
+
+    //add noise
+    x_pred(0) = px_p + 0.5*nu_a*delta_t*delta_t * cos(yaw);
+    x_pred(1) = py_p + 0.5*nu_a*delta_t*delta_t * sin(yaw);
+    x_pred(2) = v + nu_a*delta_t;
+    x_pred(3) = yaw + yawd*delta_t + 0.5*nu_yawdd*delta_t*delta_t;
+    x_pred(4) = yawd + nu_yawdd*delta_t;
+  }
+};
+
+/**
+ * Constant velocity process model on the CTRV state: the object keeps its speed
+ * and heading, and the yaw rate is zero up to the noise, so a filter with this
+ * model can be mixed with a CTRV filter (see IMM).
+ * State: [pos1 pos2 vel_abs yaw_angle yaw_rate], noise: [nu_a nu_yawdd]
+ */
+struct CVModel {
+  enum { NX = 5, NAUG = 7, YAW = 3 };
+
+  void Propagate(const Eigen::Matrix<double, NAUG, 1>& x_aug, double delta_t,
+                 Eigen::Matrix<double, NX, 1>& x_pred) const {
+    double v = x_aug(2);
+    double yaw = x_aug(3);
+    double nu_a = x_aug(5);
+    double nu_yawdd = x_aug(6);
+
+    double dist = v*delta_t + 0.5*nu_a*delta_t*delta_t;
+    x_pred(0) = x_aug(0) + dist * cos(yaw);
+    x_pred(1) = x_aug(1) + dist * sin(yaw);
+    x_pred(2) = v + nu_a*delta_t;
+    x_pred(3) = yaw + 0.5*nu_yawdd*delta_t*delta_t;
+    x_pred(4) = nu_yawdd*delta_t;
+  }
+};
+
+/**
+ * Lidar measures the position: [px py]
+ */
+struct LidarModel {
+  enum { NZ = 2 };
+  typedef Eigen::Matrix<double, NZ, 1> MeasVector;
+  typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+
+  void Transform(const Eigen::Matrix<double, CTRVModel::NX, 1>& x, MeasVector& z) const {
+    z(0) = x(0);
+    z(1) = x(1);
+  }
+
+  void NormalizeResidual(MeasVector&) const {}
+};
+
+/**
+ * Radar measures range, bearing and range rate: [r phi r_dot]
+ */
+struct RadarModel {
+  enum { NZ = 3 };
+  typedef Eigen::Matrix<double, NZ, 1> MeasVector;
+  typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+
+  void Transform(const Eigen::Matrix<double, CTRVModel::NX, 1>& x, MeasVector& z) const {
+    double p_x = x(0);
+    double p_y = x(1);
+    double v   = x(2);
+    double yaw = x(3);
+
+    double v1 = cos(yaw)*v;
+    double v2 = sin(yaw)*v;
+
+    double r = sqrt(p_x*p_x + p_y*p_y);
+    z(0) = r;                          //r
+    z(1) = atan2(p_y,p_x);             //phi
+    z(2) = (p_x*v1 + p_y*v2 ) / r;     //r_dot
+  }
+
+  void NormalizeResidual(MeasVector& z_diff) const {
+    z_diff(1) = NormalizeAngle(z_diff(1));
+  }
+};
+
+/**
+ * Two measurement models stacked into one, z = [z1 z2] with the noise covariance
+ * blockdiag(R1, R2), to apply measurements taken at the same time in a single
+ * update: the sigma points are transformed and the state residuals formed once,
+ * and one gain is solved for all of them.
+ */
+template <class First, class Second>
+struct StackedModel {
+  enum { NZ = First::NZ + Second::NZ };
+  typedef Eigen::Matrix<double, NZ, 1> MeasVector;
+  typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+
+  First first;
+  Second second;
+
+  template <class StateVector>
+  void Transform(const StateVector& x, MeasVector& z) const {
+    typename First::MeasVector z1;
+    typename Second::MeasVector z2;
+    first.Transform(x, z1);
+    second.Transform(x, z2);
+    z << z1, z2;
+  }
+
+  void NormalizeResidual(MeasVector& z_diff) const {
+    typename First::MeasVector z1 = z_diff.template head<First::NZ>();
+    typename Second::MeasVector z2 = z_diff.template tail<Second::NZ>();
+    first.NormalizeResidual(z1);
+    second.NormalizeResidual(z2);
+    z_diff << z1, z2;
+  }
+
+  static MeasVector Stack(const typename First::MeasVector& z1, const typename Second::MeasVector& z2) {
+    MeasVector z;
+    z << z1, z2;
+    return z;
+  }
+
+  static MeasMatrix StackNoise(const typename First::MeasMatrix& R1, const typename Second::MeasMatrix& R2) {
+    MeasMatrix R;
+    R.setZero();
+    R.template topLeftCorner<First::NZ, First::NZ>() = R1;
+    R.template bottomRightCorner<Second::NZ, Second::NZ>() = R2;
+    return R;
+  }
+};
+
+#endif /* UKF_CORE_H */